@@ -1,6 +1,8 @@
 cd ./IDLs
-MegrezC -c benchmark.mgz
+MegrezC --gen-mutable --gen-object-api -c benchmark.mgz
 cd ../
 g++ bm_megrez.cc -o bm_megrez -I ./IDLs/ -I ../
+g++ bm_text.cc ../compiler/parser.cc ../compiler/gen_text.cc -o bm_text -I ./IDLs/ -I ../
+g++ bm_parser.cc ../compiler/parser.cc -o bm_parser -I ../
 
 read -p " "
\ No newline at end of file
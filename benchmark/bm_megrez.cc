@@ -15,15 +15,32 @@ limitations under the License.
 ========================================================================*/
 
 #include "./IDLs/benchmark.mgz.h"
+#include <megrez/batch.h>
+#include <megrez/mapped.h>
+#include <megrez/verifier.h>
 #include <iostream>
+#include <numeric>
 #include <chrono> 
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
 using namespace benchmark;
 using namespace std;
 using namespace megrez;
 using namespace chrono;
 
-void serialize() {
+template<typename F>
+double Measure(F f, int times) {
+	auto start = system_clock::now();
+	for (int i = 0; i < times; i++)
+		f();
+	auto end = system_clock::now();
+	return double(duration_cast<nanoseconds>(end - start).count()) / times;
+}
+
+uofs_t serialize(Allocator *allocator = nullptr) {
 	//MegrezBuilder mb;
 	//auto id = 123456;
 	//auto name = mb.CreateString("NAME");
@@ -34,7 +51,7 @@ void serialize() {
 	//auto temp = CreatePerson(mb, id, name, age, gender, phone_num);
 	//mb.Finish(temp);
 	//auto serialized = GetPerson(mb.GetBufferPointer());
-	megrez::MegrezBuilder mb(4096);
+	megrez::MegrezBuilder mb(4096, allocator);
 	INFOBuilder builder(mb);
 
 	uint8_t field1 = 1;
@@ -63,9 +80,398 @@ void serialize() {
 	builder.add_field11(field11);
 	builder.add_field12("abcdefghijklmnopqrstuvwxyz");
 	builder.add_field13(ENUM_val2);
-	builder.Finish();
+	mb.Finish(builder.Finish());
 
 	auto serialized = GetINFO(builder.mb_.GetBufferPointer());
+	return mb.GetSize();
+}
+
+// A builder starting small has to grow several times per message, which is
+// where the allocator makes the difference.
+void serialize_growing(Allocator *allocator) {
+	static const string payload(4096, 'x');
+	megrez::MegrezBuilder mb(64, allocator);
+	auto field12 = mb.CreateString(payload);
+	INFOBuilder builder(mb);
+	builder.add_field12(field12);
+	builder.add_field13(ENUM_val2);
+	mb.Finish(builder.Finish());
+}
+
+void bm_allocator() {
+	const int times = 100000;
+	ArenaAllocator arena;
+	cout << "Default allocator: "
+		 << Measure([] { serialize(); }, times) << "(ns/message).\n";
+	cout << "Arena allocator:   "
+		 << Measure([&] { serialize(&arena); }, times) << "(ns/message).\n";
+	cout << "Growing buffer, default allocator: "
+		 << Measure([] { serialize_growing(nullptr); }, times) << "(ns/message).\n";
+	cout << "Growing buffer, arena allocator:   "
+		 << Measure([&] { serialize_growing(&arena); }, times) << "(ns/message).\n";
+}
+
+// Every table gets its own field layout, so none of the vtables can be
+// shared. The cost per table should stay flat as the buffer fills up.
+double build_distinct_vtables(int count) {
+	const vofs_t numfields = 16;
+	megrez::MegrezBuilder mb;
+	auto start = system_clock::now();
+	for (int i = 1; i <= count; i++) {
+		auto info = mb.StartInfo();
+		for (vofs_t field = 0; field < numfields; field++)
+			if ((i >> field) & 1)
+				mb.AddElement<int32_t>(FieldIndexToOffset(field), field + 1, 0);
+		mb.EndInfo(info, numfields);
+	}
+	auto end = system_clock::now();
+	return double(duration_cast<nanoseconds>(end - start).count()) / count;
+}
+
+void bm_vtables() {
+	const int counts[] = { 1000, 10000, 60000 };
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+		cout << counts[i] << " distinct vtables: "
+			 << build_distinct_vtables(counts[i]) << "(ns/table).\n";
+}
+
+// The element-wise path CreateVector used before: align, check capacity and
+// copy for every single element.
+template<typename T>
+Offset<Vector<T>> create_vector_elementwise(MegrezBuilder &mb, const T *v, size_t len) {
+	mb.StartVector(len, sizeof(T));
+	for (auto i = len; i; ) mb.PushElement(v[--i]);
+	return Offset<Vector<T>>(mb.EndVector(len));
+}
+
+void bm_vectors() {
+	const size_t lengths[] = { 1000, 1000000 };
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+		auto len = lengths[l];
+		auto times = static_cast<int>(10000000 / len);
+		vector<uint32_t> ints(len, 7);
+		vector<double> doubles(len, 7.0);
+		string str(len, 'x');
+		MegrezBuilder mb(static_cast<uofs_t>(len * sizeof(double) * 2));
+		cout << len << " x uint32, element-wise: "
+			 << Measure([&] { mb.Clear(); create_vector_elementwise(mb, ints.data(), len); },
+						times) << "(ns/vector).\n";
+		cout << len << " x uint32, bulk:         "
+			 << Measure([&] { mb.Clear(); mb.CreateVector(ints); }, times) << "(ns/vector).\n";
+		cout << len << " x double, element-wise: "
+			 << Measure([&] { mb.Clear(); create_vector_elementwise(mb, doubles.data(), len); },
+						times) << "(ns/vector).\n";
+		cout << len << " x double, bulk:         "
+			 << Measure([&] { mb.Clear(); mb.CreateVector(doubles); }, times) << "(ns/vector).\n";
+		cout << len << " chars string:           "
+			 << Measure([&] { mb.Clear(); mb.CreateString(str); }, times) << "(ns/string).\n";
+	}
+}
+
+// Summing a large vector by index, with the iterators, and in place, and
+// copying it out.
+void bm_iterate() {
+	const uofs_t len = 1000000;
+	vector<uint32_t> ints(len, 7);
+	MegrezBuilder mb(len * sizeof(uint32_t) * 2);
+	mb.Finish(mb.CreateVector(ints));
+	auto vec = GetRoot<Vector<uint32_t>>(mb.GetBufferPointer());
+	uint64_t sum = 0;
+	cout << len << " x uint32, Get(i):    "
+		 << Measure([&] {
+				uint64_t s = 0;
+				for (uofs_t i = 0; i < vec->Length(); i++) s += vec->Get(i);
+				sum += s;
+			}, 100)
+		 << "(ns/vector).\n";
+	cout << len << " x uint32, range-for: "
+		 << Measure([&] {
+				uint64_t s = 0;
+				for (auto e : *vec) s += e;
+				sum += s;
+			}, 100) << "(ns/vector).\n";
+	vector<uint32_t> copy(len);
+	cout << len << " x uint32, CopyTo:    "
+		 << Measure([&] {
+				vec->CopyTo(copy.data(), vec->size());
+				sum += copy[len / 2];
+			}, 100) << "(ns/vector).\n";
+	#if MEGREZ_LITTLEENDIAN
+		cout << len << " x uint32, data():    "
+			 << Measure([&] {
+					sum += accumulate(vec->data(), vec->data() + vec->size(), uint64_t(0));
+				}, 100)
+			 << "(ns/vector).\n";
+	#endif
+	uint64_t expected = uint64_t(len) * 7 * (MEGREZ_LITTLEENDIAN ? 300 : 200) + 7 * 100;
+	if (sum != expected) cout << "Wrong sum!\n";
+}
+
+// Reading a buffer that starts at an odd address, as a payload cut out of
+// a packet does: copied to aligned memory first, against read in place
+// with UnalignedReads.
+void bm_unaligned() {
+	const uofs_t len = 1000000;
+	vector<uint32_t> ints(len, 7);
+	MegrezBuilder mb(len * sizeof(uint32_t) * 2);
+	mb.Finish(mb.CreateVector(ints));
+	vector<uint8_t> packet(mb.GetSize() + 1);
+	auto payload = packet.data() + 1;
+	memcpy(payload, mb.GetBufferPointer(), mb.GetSize());
+	vector<uint8_t> aligned(mb.GetSize());
+	uint64_t sum = 0;
+	cout << len << " x uint32, copy + aligned: "
+		 << Measure([&] {
+				memcpy(aligned.data(), payload, aligned.size());
+				auto vec = GetRoot<Vector<uint32_t>>(aligned.data());
+				for (auto e : *vec) sum += e;
+			}, 100) << "(ns/vector).\n";
+	cout << len << " x uint32, unaligned:      "
+		 << Measure([&] {
+				auto vec = GetRoot<Vector<uint32_t, UnalignedReads>, UnalignedReads>(payload);
+				for (auto e : *vec) sum += e;
+			}, 100) << "(ns/vector).\n";
+	if (sum != uint64_t(len) * 7 * 200) cout << "Wrong sum!\n";
+}
+
+// Updating two fields of a received message in place, against building
+// it again.
+void bm_mutate() {
+	megrez::MegrezBuilder mb;
+	INFOBuilder builder(mb);
+	builder.add_field6(1);  // fields left at their default have no storage
+	builder.add_field8(1);
+	builder.add_field12("abcdefghijklmnopqrstuvwxyz");
+	mb.Finish(builder.Finish());
+	auto info = GetMutableINFO(mb.GetBufferPointer());
+	int32_t counter = 0;
+	cout << "Info, mutate in place: "
+		 << Measure([&] {
+				info->mutate_field6(++counter);
+				info->mutate_field8(counter * 1000);
+			}, 1000000) << "(ns/update).\n";
+	cout << "Info, rebuild:         " << Measure([] { serialize(); }, 100000) << "(ns/update).\n";
+	if (GetINFO(mb.GetBufferPointer())->field6() != counter) cout << "Wrong value!\n";
+}
+
+// A round trip through the object API: unpacking 1000 entries and their
+// index and packing them back, with the objects on the heap or in an arena.
+void bm_object() {
+	MegrezBuilder mb;
+	vector<Offset<ENTRY>> entries;
+	vector<Offset<String>> keys;
+	vector<int32_t> values;
+	for (int i = 0; i < 1000; i++) {
+		keys.push_back(mb.CreateString("entry-" + to_string(i)));
+		values.push_back(i);
+		entries.push_back(CreateENTRY(mb, keys.back(), i));
+	}
+	auto sorted = mb.CreateVectorOfSortedInfos(&entries);
+	mb.Finish(CreateLOOKUP(mb, sorted, mb.CreateMap(keys, values)));
+	auto lookup = GetRoot<LOOKUP>(mb.GetBufferPointer());
+	MegrezBuilder out;
+	cout << "1000 entries, unpack (heap):  "
+		 << Measure([&] { lookup->UnPack(); }, 1000) << "(ns/message).\n";
+	ArenaAllocator arena;
+	cout << "1000 entries, unpack (arena): "
+		 << Measure([&] { lookup->UnPack(&arena); arena.Reset(); }, 1000) << "(ns/message).\n";
+	auto object = lookup->UnPack(&arena);
+	cout << "1000 entries, pack:           "
+		 << Measure([&] {
+				out.Clear();
+				out.Reserve(LOOKUP::PackedSize(*object));
+				out.Finish(LOOKUP::Pack(out, *object));
+			}, 1000) << "(ns/message).\n";
+	int32_t value = 0;
+	if (!GetRoot<LOOKUP>(out.GetBufferPointer())->index()->Find("entry-999", &value) ||
+		value != 999)
+		cout << "Index lost in the round trip!\n";
+}
+
+// Loading a 64MiB buffer from a file before reading its root: copied
+// through a stream, copied by LoadFile, and mapped in place.
+void bm_load() {
+	const char *name = "bm_load.tmp";
+	const uofs_t len = 16 * 1024 * 1024;
+	{
+		MegrezBuilder mb(len * sizeof(uint32_t) + 1024);
+		mb.Finish(mb.CreateVector(vector<uint32_t>(len, 7)));
+		SaveFile(name, reinterpret_cast<const char *>(mb.GetBufferPointer()), mb.GetSize(), true);
+	}
+	uofs_t total = 0;
+	cout << "64MiB file, istreambuf_iterator: "
+		 << Measure([&] {
+				ifstream ifs(name, ifstream::binary);
+				string buf((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+				total += GetRoot<Vector<uint32_t>>(buf.data())->Length();
+			}, 3) / 1000000 << "(ms/load).\n";
+	cout << "64MiB file, LoadFile:            "
+		 << Measure([&] {
+				string buf;
+				LoadFile(name, true, &buf);
+				total += GetRoot<Vector<uint32_t>>(buf.data())->Length();
+			}, 3) / 1000000 << "(ms/load).\n";
+	cout << "64MiB file, MappedFile:          "
+		 << Measure([&] {
+				MappedFile file(name, MappedFile::kRandom);
+				total += GetRoot<Vector<uint32_t>>(file.data())->Length();
+			}, 3) / 1000000 << "(ms/load).\n";
+	if (total != len * 9) cout << "Wrong length!\n";
+	remove(name);
+}
+
+// Looking names up in a sorted vector of infos, by binary search, and in a
+// map, by hashing.
+void bm_lookup() {
+	const int len = 100000;
+	MegrezBuilder mb;
+	vector<Offset<ENTRY>> entries;
+	vector<Offset<String>> keys;
+	vector<int32_t> values;
+	vector<string> names;
+	for (int i = 0; i < len; i++) {
+		names.push_back("entry-" + to_string(i * 7919 % len));
+		keys.push_back(mb.CreateString(names.back()));
+		values.push_back(i);
+		entries.push_back(CreateENTRY(mb, keys.back(), i));
+	}
+	auto sorted = mb.CreateVectorOfSortedInfos(&entries);
+	auto index = mb.CreateMap(keys, values);
+	mb.Finish(CreateLOOKUP(mb, sorted, index));
+	auto lookup = GetRoot<LOOKUP>(mb.GetBufferPointer());
+	int64_t sum = 0;
+	cout << len << " names, LookupByKey: "
+		 << Measure([&] {
+				int64_t s = 0;
+				for (auto &name : names) s += lookup->entries()->LookupByKey(name.c_str())->value();
+				sum += s;
+			}, 10) / len << "(ns/lookup).\n";
+	cout << len << " names, Map::Find:   "
+		 << Measure([&] {
+				int64_t s = 0;
+				int32_t value;
+				for (auto &name : names) if (lookup->index()->Find(name.c_str(), &value)) s += value;
+				sum += s;
+			}, 10) / len << "(ns/lookup).\n";
+	if (sum != int64_t(len) * (len - 1) * 10) cout << "Wrong sum!\n";
+}
+
+// Payloads repeating the same few strings, vectors and infos over and over.
+// The infos are {host: string, ports: [ushort], kind: int}.
+uofs_t build_repeated(bool shared) {
+	const char *hosts[] = { "alpha.example.com", "beta.example.com", "gamma.example.com" };
+	const uint16_t ports[][4] = { { 80, 443 }, { 8080, 8443, 9090 }, { 22 } };
+	const size_t port_counts[] = { 2, 3, 1 };
+	megrez::MegrezBuilder mb;
+	vector<Offset<Info>> infos;
+	for (int i = 0; i < 3000; i++) {
+		auto h = i % 3;
+		auto host = shared ? mb.CreateSharedString(hosts[h]) : mb.CreateString(hosts[h]);
+		auto tags = shared ? mb.CreateSharedVector(ports[h], port_counts[h])
+						   : mb.CreateVector(ports[h], port_counts[h]);
+		auto start = mb.StartInfo();
+		mb.AddOffset(FieldIndexToOffset(0), host);
+		mb.AddOffset(FieldIndexToOffset(1), tags);
+		mb.AddElement<int32_t>(FieldIndexToOffset(2), h, 0);
+		infos.push_back(Offset<Info>(shared ? mb.EndSharedInfo(start, 3)
+											: mb.EndInfo(start, 3)));
+	}
+	mb.Finish(mb.CreateVector(infos));
+	return mb.GetSize();
+}
+
+void bm_shared() {
+	cout << "Repeated payload, plain:  " << build_repeated(false) << "(bytes).\n";
+	cout << "Repeated payload, shared: " << build_repeated(true) << "(bytes).\n";
+}
+
+// Verification of a batch of untrusted messages, in bytes per second.
+void bm_verifier() {
+	const int messages = 10000;
+	BatchBuilder batch;
+	for (int i = 0; i < messages; i++) {
+		auto &mb = batch.builder();
+		auto str = mb.CreateString("abcdefghijklmnopqrstuvwxyz");
+		batch.Finish(CreateINFO(mb, 1, 2, 3, 4, 5, i, 7, 8, 9, 10.0f, 11.0, str, ENUM_val2));
+	}
+	int valid = 0;
+	auto verify = [&] {
+		BatchReader reader(batch.data(), batch.size());
+		const uint8_t *msg;
+		uofs_t size;
+		// Messages are aligned together with their size prefix.
+		while (reader.Next(&msg, &size)) {
+			Verifier verifier(msg - sizeof(uofs_t), size + sizeof(uofs_t));
+			valid += VerifySizePrefixedINFOBuffer(verifier);
+		}
+	};
+	auto ns = Measure(verify, 100);
+	if (valid != messages * 100) cout << "Verifier rejected a valid message!\n";
+	cout << "Verifier: " << batch.size() / ns << "(GB/s), "
+		 << ns / messages << "(ns/message).\n";
+}
+
+// All fields of INFO set, through the builder and through the layout
+// generated at compile time.
+double build_infos(bool fast) {
+	const int count = 1000;
+	megrez::MegrezBuilder mb(64 * 1024);
+	auto build = [&] {
+		mb.Clear();
+		auto str = mb.CreateString("abcdefghijklmnopqrstuvwxyz");
+		for (int i = 0; i < count; i++) {
+			if (fast)
+				CreateINFOFast(mb, 1, 2, 3, 4, 5, i, 7, 8, 9, 10.0f, 11.0, str, ENUM_val2);
+			else
+				CreateINFO(mb, 1, 2, 3, 4, 5, i, 7, 8, 9, 10.0f, 11.0, str, ENUM_val2);
+		}
+	};
+	return Measure(build, 1000) / count;
+}
+
+void bm_fast() {
+	cout << "Info, builder:   " << build_infos(false) << "(ns/info).\n";
+	cout << "Info, fast path: " << build_infos(true) << "(ns/info).\n";
+}
+
+void bm_batch() {
+	const int messages = 10000;
+	BatchBuilder batch;
+	auto build = [&] {
+		batch.Clear();
+		for (int i = 0; i < messages; i++) {
+			auto &mb = batch.builder();
+			INFOBuilder builder(mb);
+			builder.add_field6(i);
+			builder.add_field12("abcdefghijklmnopqrstuvwxyz");
+			batch.Finish(builder.Finish());
+		}
+	};
+	int64_t sum = 0;
+	auto read = [&] {
+		BatchReader reader(batch.data(), batch.size());
+		while (auto info = reader.Next<INFO>()) sum += info->field6();
+	};
+	// The same messages without the copy into the batch, as if each were
+	// built in place. Its per-message state has to be reset either way, so
+	// that messages don't share vtables.
+	MegrezBuilder single(1024);
+	auto build_only = [&] {
+		for (int i = 0; i < messages; i++) {
+			INFOBuilder builder(single);
+			builder.add_field6(i);
+			builder.add_field12("abcdefghijklmnopqrstuvwxyz");
+			single.FinishSizePrefixed(builder.Finish());
+			single.Clear();
+		}
+	};
+	cout << "Batch of " << messages << " messages, build: "
+		 << Measure(build, 100) / messages << "(ns/message), without the copy: "
+		 << Measure(build_only, 100) / messages << "(ns/message).\n";
+	cout << "Batch of " << messages << " messages, read:  "
+		 << Measure(read, 100) / messages << "(ns/message), "
+		 << batch.size() << "(bytes).\n";
+	if (sum != int64_t(messages) * (messages - 1) / 2 * 100) cout << "Wrong sum!\n";
 }
 
 int main() {
@@ -79,9 +485,24 @@ int main() {
 	cout << "Serialization time: " 
 		 << double(duration.count()) * nanoseconds::period::num / nanoseconds::period::den 
 		 << "(nanoseconds).\n";
+	cout << "Message size (" << MEGREZ_OFFSET_BITS << "-bit offsets): "
+		 << serialize() << "(bytes).\n";
+	bm_allocator();
+	bm_batch();
+	bm_verifier();
+	bm_mutate();
+	#if MEGREZ_OFFSET_BITS > 16  // these build buffers well beyond 32KiB
+		bm_vtables();
+		bm_vectors();
+		bm_iterate();
+		bm_unaligned();
+		bm_shared();
+		bm_fast();
+		bm_lookup();
+		bm_object();
+		bm_load();
+	#endif
 
-	INFO info;
-	cout << info.field12()->c_str();
 	cin.get();
 	cin.get();
 	return 0;
@@ -0,0 +1,100 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+// Schema parsing speed, on a generated schema with as many types and
+// fields as the largest ones MegrezC is run on. Built together with the
+// parser, see autogen.sh.
+
+#include "compiler/idl.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace megrez;
+using namespace chrono;
+
+template<typename F>
+double Measure(F f, int times) {
+	auto start = system_clock::now();
+	for (int i = 0; i < times; i++)
+		f();
+	auto end = system_clock::now();
+	return double(duration_cast<nanoseconds>(end - start).count()) / times;
+}
+
+// `infos` infos of `fields` fields each, of every kind of type, referring
+// to enums, structs and the infos declared before them.
+string make_schema(int infos, int fields) {
+	static const char *scalars[] = { "bool", "byte", "ubyte", "short", "ushort", "int",
+									 "uint", "long", "ulong", "float", "double" };
+	const int enums = 100, structs = 500;
+	string schema = "namespace generated.schema;\n\n";
+	for (int i = 0; i < enums; i++) {
+		schema += "enum Kind" + to_string(i) + " : ubyte { ";
+		for (int v = 0; v < 8; v++) schema += (v ? ", Value" : "Value") + to_string(v);
+		schema += " }\n";
+	}
+	for (int i = 0; i < structs; i++) {
+		schema += "struct Point" + to_string(i) + " { x:float; y:float; z:int; id:long; }\n";
+	}
+	for (int i = 0; i < infos; i++) {
+		schema += "\n/// Generated info number " + to_string(i) + ".\n";
+		schema += "info Record" + to_string(i) + " {\n";
+		for (int f = 0; f < fields; f++) {
+			auto name = "\tfield_" + to_string(f) + "_of_record" + to_string(i) + ":";
+			switch ((i + f) % 8) {
+				case 0: schema += name + (f < 8 ? "string (key);\n" : "string;\n"); break;
+				case 1: schema += name + "[int];\n"; break;
+				case 2: schema += name + "Kind" + to_string((i + f) % enums) + " = Value3;\n"; break;
+				case 3: schema += name + "Point" + to_string((i * f) % structs) + ";\n"; break;
+				case 4:
+					schema += i ? name + "Record" + to_string(i / 2) + ";\n"
+								: name + "string;\n";
+					break;
+				case 5: schema += name + "[string] (deprecated);\n"; break;
+				default: schema += name + scalars[(i + f) % 11] + " = 1;\n"; break;
+			}
+		}
+		schema += "}\n";
+	}
+	schema += "\nMain Record" + to_string(infos - 1) + ";\n";
+	return schema;
+}
+
+int main() {
+	// The same 50K fields in a few large infos and in many small ones: the
+	// second shape stresses the lookups and bookkeeping per type.
+	const int shapes[][2] = { { 5000, 10 }, { 25000, 2 } };
+	for (auto &shape : shapes) {
+		const int infos = shape[0], fields = shape[1];
+		auto schema = make_schema(infos, fields);
+		bool ok = true;
+		string error;
+		auto ns = Measure([&] {
+			Parser parser;
+			if (!parser.Parse(schema.c_str())) { ok = false; error = parser.error_; }
+		}, 10);
+		if (!ok) {
+			cout << error << "\n";
+			return 1;
+		}
+		cout << "Parse of " << infos << " infos, " << infos * fields << " fields: "
+			 << ns / 1000000 << "(ms), " << schema.size() / ns * 1000 << "(MB/s), "
+			 << ns / (infos * fields) << "(ns/field).\n";
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+// Throughput of the JSON conversions: GenerateText, as used by MegrezC -t,
+// and Parser::ParseJsonLines for streams of JSON objects one per line.
+// Built together with the compiler sources, see autogen.sh.
+
+#include "./IDLs/benchmark.mgz.h"
+#include "compiler/idl.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace benchmark;
+using namespace std;
+using namespace megrez;
+using namespace chrono;
+
+template<typename F>
+double Measure(F f, int times) {
+	auto start = system_clock::now();
+	for (int i = 0; i < times; i++)
+		f();
+	auto end = system_clock::now();
+	return double(duration_cast<nanoseconds>(end - start).count()) / times;
+}
+
+void build_info(MegrezBuilder &mb, int i) {
+	auto name = mb.CreateString("abcdefghijklmnopqrstuvwxyz");
+	INFOBuilder builder(mb);
+	builder.add_field1(true);
+	builder.add_field2(static_cast<int8_t>(-i));
+	builder.add_field3(static_cast<uint8_t>(i));
+	builder.add_field4(static_cast<int16_t>(i * 3));
+	builder.add_field5(static_cast<uint16_t>(i * 5));
+	builder.add_field6(i * 1000003);
+	builder.add_field7(static_cast<uint32_t>(i) * 2654435761u);
+	builder.add_field8(-static_cast<int64_t>(i) * 1000000007);
+	builder.add_field9(static_cast<uint64_t>(i) << 40);
+	builder.add_field10(i * 0.25f);
+	builder.add_field11(i / 3.0);
+	builder.add_field12(name);
+	builder.add_field13(ENUM_val2);
+	mb.Finish(builder.Finish());
+}
+
+// JSON of one buffer, compact and indented, in MB/s of buffer and of text.
+void report(const Parser &parser, const char *what, const MegrezBuilder &mb, int times) {
+	std::string text;
+	const int indents[] = { -1, 2 };
+	for (auto indent : indents) {
+		auto ns = Measure([&] { GenerateText(parser, mb.GetBufferPointer(), indent, &text); },
+						  times);
+		cout << what << (indent < 0 ? ", compact:  " : ", indented: ")
+			 << mb.GetSize() / ns * 1000 << "(MB/s binary), "
+			 << text.size() / ns * 1000 << "(MB/s JSON), " << ns << "(ns/buffer).\n";
+	}
+}
+
+// The JSON of one buffer repeated `lines` times as a stream, parsed back
+// into a batch of buffers, in MB/s of JSON.
+void report_ingest(Parser &parser, const char *what, const MegrezBuilder &mb, int lines,
+				   int times) {
+	std::string json, stream;
+	GenerateText(parser, mb.GetBufferPointer(), -1, &json);
+	for (int i = 0; i < lines; i++) stream += json + "\n";
+	BatchBuilder batch;
+	bool ok = true;
+	auto ns = Measure([&] {
+		batch.Clear();
+		ok = parser.ParseJsonLines(stream.c_str(), &batch) && ok;
+	}, times);
+	if (!ok) cout << parser.error_ << "\n";
+	cout << what << ", ingest:   " << stream.size() / ns * 1000 << "(MB/s JSON), "
+		 << ns / lines << "(ns/object).\n";
+}
+
+int main() {
+	std::string schema;
+	if (!LoadFile("IDLs/benchmark.mgz", false, &schema)) {
+		cout << "Run from the benchmark directory.\n";
+		return 1;
+	}
+	Parser parser;
+	if (!parser.Parse(schema.c_str())) {
+		cout << parser.error_ << "\n";
+		return 1;
+	}
+
+	MegrezBuilder mb;
+	build_info(mb, 12345);
+	report(parser, "INFO", mb, 1000000);
+	report_ingest(parser, "INFO", mb, 1000, 1000);
+
+	const int len = 10000;
+	MegrezBuilder lookup;
+	vector<Offset<ENTRY>> entries;
+	vector<Offset<String>> keys;
+	vector<int32_t> values;
+	for (int i = 0; i < len; i++) {
+		keys.push_back(lookup.CreateString("entry-" + to_string(i * 7919 % len)));
+		values.push_back(i);
+		entries.push_back(CreateENTRY(lookup, keys.back(), i));
+	}
+	auto sorted = lookup.CreateVectorOfSortedInfos(&entries);
+	lookup.Finish(CreateLOOKUP(lookup, sorted, lookup.CreateMap(keys, values)));
+	parser.SetMainType("LOOKUP");
+	report(parser, "LOOKUP of 10000 entries", lookup, 100);
+	report_ingest(parser, "LOOKUP of 10000 entries", lookup, 1, 100);
+	// Map keys are unique: a repeated one is an error, not a second entry.
+	if (parser.ParseJson("{ \"index\": { \"a\": 1, \"a\": 2 } }") ||
+		parser.error_.find("Map key set more than once: a") == std::string::npos)
+		cout << "Duplicate map key accepted!\n";
+	return 0;
+}
@@ -1,6 +1,10 @@
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <iostream>
+#include <limits>
+#include <thread>
 #include "compiler/idl.h"
 
 const char *program_name = NULL;
@@ -13,10 +17,13 @@ struct Generator {
 	const char *ext_l;
 	const char *name;
 	const char *help;
+	bool binary_input;  // runs on the binary FILEs after --, not on schemas
 };
 
 const Generator generators[] = {
-	{ megrez::GenerateCPP, "c", "cpp", "C++", "     Generate C++ header files;" }
+	{ megrez::GenerateCPP, "c", "cpp", "C++", "     Generate C++ header files;", false },
+	{ megrez::GenerateTextFile, "t", "json", "text", "    Generate JSON for the binary FILEs after --;", true },
+	{ megrez::GenerateBinarySchema, "b", "schema", "binary schema", "  Generate a binary schema (.mbs) for reflection;", false }
 };
 
 int get_max_len() {
@@ -37,12 +44,25 @@ void PrintHelp() {
 	}
 	std::cout << "\n"
 
-	   << "  -o [PATH]     Prefix PATH to all generated files\n\n"
-
-	   << "FILEs may depend on declarations in earlier files.\n"
+	   << "  -o [PATH]     Prefix PATH to all generated files\n"
+	   << "  -I [PATH]     Search for included files in PATH\n"
+	   << "  --jobs [N]    Compile N FILEs at once (default: one per core)\n"
+	   << "  --offset-bits [BITS]\n"
+	   << "                Generate code for 16, 32 (default) or 64-bit offsets\n"
+	   << "  --gen-mutable Generate accessors to change buffers in place\n"
+	   << "  --gen-object-api\n"
+	   << "                Generate native <Type>T objects with UnPack and Pack\n"
+	   << "  --unaligned-reads\n"
+	   << "                Generate accessors that read buffers at any address\n\n"
+
+	   << "Each FILE is compiled on its own, with the files it includes.\n"
+	   << "FILEs after -- are binary buffers of the main type of the schema.\n"
 	   << "Output files are named using the base file name of the input,\n"
-	   << "and written to the current directory or the path given by -o.\n"
-	   << "example: MegrezC -c schema1.mgz\n";
+	   << "and written to the current directory or the path given by -o,\n"
+	   << "only when their contents change.\n"
+	   << "example: MegrezC -c schema1.mgz\n"
+	   << "         MegrezC -t schema1.mgz -- data1.bin\n"
+	   << "         MegrezC -b schema1.mgz\n";
 }
 void Error(const char *err, const char *obj = nullptr, bool usage = false);
 void Error(const char *err, const char *obj, bool usage) {
@@ -56,19 +76,33 @@ void Error(const char *err, const char *obj, bool usage) {
 	exit(1);
 }
 
-std::string StripExtension(const std::string &filename) {
-	size_t i = filename.find_last_of(".");
-	return i != std::string::npos ? filename.substr(0, i) : filename;
+// Parses a schema FILE with its own parser and runs the enabled generators
+// on it. Returns the error, or "" if there is none.
+std::string CompileSchema(megrez::Parser &parser, const std::string &filename,
+						  const bool *generator_enabled, const std::string &output_path) {
+	std::string contents;
+	if (!megrez::LoadFile(filename.c_str(), true, &contents))
+		return "Unable to load file: " + filename;
+	if (!parser.Parse(contents.c_str(), filename.c_str()))
+		return filename + ": " + parser.error_;
+	std::string filebase = megrez::StripExtension(filename);
+	for (size_t i = 0; i < sizeof(generators) / sizeof(generators[0]); ++i)
+		if (generator_enabled[i] && !generators[i].binary_input &&
+			!generators[i].generate(parser, output_path, filebase))
+			return std::string("Unable to generate ") + generators[i].name + " for " + filebase;
+	return "";
 }
 
 int main(int argc, const char *argv[]) {
 	program_name = argv[0];
-	megrez::Parser parser;
+	megrez::IDLOptions opts;
 	std::string output_path;
 	const size_t num_generators = sizeof(generators) / sizeof(generators[0]);
 	bool generator_enabled[num_generators] = { false };
 	bool any_generator = false;
 	std::vector<std::string> filenames;
+	size_t binary_files_from = std::numeric_limits<size_t>::max();
+	size_t jobs = std::thread::hardware_concurrency();
 	for (int i = 1; i < argc; i++) {
 		const char *arg = argv[i];
 		if (arg[0] == '-' && arg[1] != '-') {
@@ -79,6 +113,10 @@ int main(int argc, const char *argv[]) {
 					if (++i >= argc) { Error("Missing path following", arg, true); }
 					output_path = argv[i];
 					break;
+				case 'I':
+					if (++i >= argc) { Error("Missing path following", arg, true); }
+					opts.include_paths.push_back(argv[i]);
+					break;
 				default:
 					for (size_t i = 0; i < num_generators; ++i) 
 						if(!strcmp(arg+1, generators[i].ext_s)) {
@@ -91,16 +129,45 @@ int main(int argc, const char *argv[]) {
 					break;
 			}
 
+		} else if (!strcmp(arg, "--")) {
+			binary_files_from = filenames.size();
 		} else if (arg[0] == '-' && arg[1] == '-') {
-			std::string arg_ = arg;
+			std::string arg_ = arg + 2;
+			if (arg_ == "offset-bits") {
+				if (++i >= argc) { Error("Missing width following", arg, true); }
+				opts.offset_bits = atoi(argv[i]);
+				if (opts.offset_bits != 16 &&
+					opts.offset_bits != 32 &&
+					opts.offset_bits != 64)
+					{ Error("Offset width must be 16, 32 or 64", argv[i], true); }
+				continue;
+			}
+			if (arg_ == "gen-mutable") {
+				opts.generate_mutable = true;
+				continue;
+			}
+			if (arg_ == "gen-object-api") {
+				opts.generate_object_api = true;
+				continue;
+			}
+			if (arg_ == "unaligned-reads") {
+				opts.unaligned_reads = true;
+				continue;
+			}
+			if (arg_ == "jobs") {
+				if (++i >= argc) { Error("Missing count following", arg, true); }
+				if (atoi(argv[i]) < 1) { Error("Invalid number of jobs", argv[i], true); }
+				jobs = atoi(argv[i]);
+				continue;
+			}
+			bool found = false;
 			for (size_t i = 0; i < num_generators; ++i) 
-				if(arg_.substr(2, arg_.length()-2) == generators[i].ext_l) {
+				if(arg_ == generators[i].ext_l) {
 					generator_enabled[i] = true;
 					any_generator = true;
-					
-				} else {
-					Error("Unknown commandline argument", arg, true);
+					found = true;
 				}
+			if (!found) { Error("Unknown commandline argument", arg, true); }
 
 		} else { filenames.push_back(argv[i]); }
 	}
@@ -111,32 +178,51 @@ int main(int argc, const char *argv[]) {
 			  "Specify one of -c --cpp etc.", true); 
 	}
 
-	// Now process the files:
-	for (auto file_it = filenames.begin();
-		 file_it != filenames.end();
-		 ++file_it) {
-			std::string contents;
-			if (!megrez::LoadFile(file_it->c_str(), true, &contents))
-				{ Error("Unable to load file", file_it->c_str()); }
-			if (!parser.Parse(contents.c_str()))
-				{ Error(parser.error_.c_str()); }
-
-			std::string filebase = StripExtension(*file_it);
-
-			for (size_t i = 0; i < num_generators; ++i) 
-				if (generator_enabled[i]) 
-					if (!generators[i].generate(parser, output_path, filebase)) {
-						Error((std::string("Unable to generate ") +
-							   generators[i].name + " for " +
-							   filebase).c_str());
-					}
-
-			for (auto it = parser.enums_.vec.begin(); it != parser.enums_.vec.end(); ++it)
-				{ (*it)->generated = true; }
-			
-			for (auto it = parser.structs_.vec.begin(); it != parser.structs_.vec.end(); ++it)
-				{ (*it)->generated = true; }
+	// Schemas don't depend on each other beyond their includes, so they are
+	// compiled in parallel, each by its own parser. Included files are
+	// parsed once for all of them. The parser of the last one is kept to
+	// read the binary files with.
+	megrez::IncludeCache include_cache;
+	size_t num_schemas = std::min(binary_files_from, filenames.size());
+	std::unique_ptr<megrez::Parser> last_parser;
+	std::vector<std::string> errors(num_schemas);
+	std::atomic<size_t> next_schema(0);
+	auto compile = [&]() {
+		for (size_t i; (i = next_schema++) < num_schemas;) {
+			std::unique_ptr<megrez::Parser> parser(new megrez::Parser(&include_cache));
+			parser->opts = opts;
+			errors[i] = CompileSchema(*parser, filenames[i], generator_enabled, output_path);
+			if (i == num_schemas - 1) last_parser = std::move(parser);
+		}
+	};
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < std::min(jobs, num_schemas); i++) workers.emplace_back(compile);
+	compile();
+	for (auto it = workers.begin(); it != workers.end(); ++it) it->join();
+	for (auto it = errors.begin(); it != errors.end(); ++it)
+		if (!it->empty()) { Error(it->c_str()); }
+
+	for (size_t i = num_schemas; i < filenames.size(); i++) {
+		auto &filename = filenames[i];
+		if (!last_parser || !last_parser->main_struct_def)
+			{ Error("No main type set in the schema for", filename.c_str()); }
+		auto &parser = *last_parser;
+		std::string contents;
+		if (!megrez::LoadFile(filename.c_str(), true, &contents))
+			{ Error("Unable to load file", filename.c_str()); }
+		if (contents.size() < sizeof(megrez::uofs_t))
+			{ Error("File too short to be a buffer", filename.c_str()); }
+		parser.builder_.Clear();
+		parser.builder_.PushBytes(reinterpret_cast<const uint8_t *>(contents.data()),
+								  contents.size());
+		std::string filebase = megrez::StripExtension(filename);
+		for (size_t i = 0; i < num_generators; ++i) 
+			if (generator_enabled[i] && generators[i].binary_input) 
+				if (!generators[i].generate(parser, output_path, filebase)) {
+					Error((std::string("Unable to generate ") + generators[i].name + " for " +
+						   filebase + ": not a valid buffer, or the output can't be written").c_str());
+				}
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -14,6 +14,9 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ========================================================================*/
 
+#include <algorithm>
+#include <cctype>
+
 #include "megrez/basic.h"
 #include "megrez/builder.h"
 #include "megrez/info.h"
@@ -37,6 +40,15 @@ static std::string GenTypeBasic(const Type &type) {
 
 static std::string GenTypeWire(const Type &type, const char *postfix);
 
+// Types declared in an included file are qualified with its namespace.
+static std::string GenTypeName(const Definition &def) {
+	if (!def.generated) return def.name;
+	std::string name;
+	for (auto it = def.name_space.begin(); it != def.name_space.end(); ++it)
+		name += *it + "::";
+	return name + def.name;
+}
+
 static std::string GenTypePointer(const Type &type) {
 	switch (type.base_type) {
 		case BASE_TYPE_STRING:
@@ -44,7 +56,10 @@ static std::string GenTypePointer(const Type &type) {
 		case BASE_TYPE_VECTOR:
 			return "megrez::Vector<" + GenTypeWire(type.VectorType(), "") + ">";
 		case BASE_TYPE_STRUCT:
-			return type.struct_def->name;
+			return GenTypeName(*type.struct_def);
+		case BASE_TYPE_MAP:
+			return "megrez::Map<" + GenTypeWire(type.KeyType(), "") + ", " +
+				GenTypeWire(type.VectorType(), "") + ">";
 		case BASE_TYPE_UNION:
 		default:
 			return "void";
@@ -65,6 +80,36 @@ static std::string GenTypeGet(
 		: beforeptr + GenTypePointer(type) + afterptr;
 }
 
+// With --unaligned-reads, accessors pass UnalignedReads to the runtime and
+// return strings, vectors and maps that read with it too.
+static std::string GenReadPolicy(const Parser &parser) {
+	return parser.opts.unaligned_reads ? ", megrez::UnalignedReads" : "";
+}
+
+static std::string GenTypeRead(const Parser &parser, const Type &type) {
+	if (!parser.opts.unaligned_reads) return GenTypePointer(type);
+	switch (type.base_type) {
+		case BASE_TYPE_STRING:
+			return "megrez::BasicString<megrez::UnalignedReads>";
+		case BASE_TYPE_VECTOR:
+			return "megrez::Vector<" + GenTypeWire(type.VectorType(), "") +
+				GenReadPolicy(parser) + ">";
+		case BASE_TYPE_MAP:
+			return "megrez::Map<" + GenTypeWire(type.KeyType(), "") + ", " +
+				GenTypeWire(type.VectorType(), "") + GenReadPolicy(parser) + ">";
+		default:
+			return GenTypePointer(type);
+	}
+}
+
+static std::string GenTypeGetRead(const Parser &parser, const Type &type,
+								  const char *afterbasic, const char *beforeptr,
+								  const char *afterptr) {
+	return IsScalar(type.base_type)
+		? GenTypeBasic(type) + afterbasic
+		: beforeptr + GenTypeRead(parser, type) + afterptr;
+}
+
 static void GenComment(
 	  const std::string &dc,
 	  std::string *code_ptr,
@@ -74,6 +119,32 @@ static void GenComment(
 		code += std::string(prefix) + "///" + dc + "\n";
 	}
 }
+// Verify<Union>, which checks the info a union field refers to by its tag.
+static std::string GenUnionVerifyName(const EnumDef &enum_def) {
+	std::string name;
+	if (enum_def.generated) {
+		for (auto it = enum_def.name_space.begin(); it != enum_def.name_space.end(); ++it)
+			name += *it + "::";
+	}
+	return name + "Verify" + enum_def.name;
+}
+
+static void GenUnionVerify(EnumDef &enum_def, std::string *code_ptr) {
+	if (enum_def.generated || !enum_def.is_union) return;
+	std::string &code = *code_ptr;
+	code += "inline bool Verify" + enum_def.name;
+	code += "(megrez::Verifier &verifier, const void *obj, uint8_t type) {\n";
+	code += "\tswitch (type) {\n";
+	for (auto it = enum_def.vals.vec.begin(); it != enum_def.vals.vec.end(); ++it) {
+		auto &ev = **it;
+		code += "\t\tcase " + enum_def.name + "_" + ev.name + ":\n\t\t\treturn ";
+		code += ev.struct_def
+			? "verifier.VerifyInfo(static_cast<const " + GenTypeName(*ev.struct_def) + " *>(obj));\n"
+			: std::string("true;\n");
+	}
+	code += "\t\tdefault:\n\t\t\treturn false;\n\t}\n}\n\n";
+}
+
 static void GenEnum(EnumDef &enum_def, std::string *code_ptr) {
 	if (enum_def.generated) return;
 	std::string &code = *code_ptr;
@@ -107,10 +178,540 @@ static void GenEnum(EnumDef &enum_def, std::string *code_ptr) {
 			code += " - " + enum_def.name + "_" + enum_def.vals.vec.front()->name;
 		code += "]; }\n\n";
 	}
+	// Defined after the infos it verifies, see GenUnionVerify.
+	if (enum_def.is_union) {
+		code += "inline bool Verify" + enum_def.name;
+		code += "(megrez::Verifier &verifier, const void *obj, uint8_t type);\n\n";
+	}
+}
+// Size of a field inside an info. Inline structs are grouped with 4 byte
+// fields as before, references follow the offset width of the generated code.
+static size_t FieldSize(const Parser &parser, const Type &type) {
+	if (IsScalar(type.base_type) || IsStruct(type)) return SizeOf(type.base_type);
+	return parser.opts.offset_bits / 8;
+}
+
+// Size and alignment of a field as laid out by the Create<Type>Fast path.
+static size_t FixedFieldSize(const Parser &parser, const Type &type) {
+	if (IsScalar(type.base_type) || IsStruct(type)) return InlineSize(type);
+	return parser.opts.offset_bits / 8;
+}
+
+static size_t FixedFieldAlignment(const Parser &parser, const Type &type) {
+	if (IsScalar(type.base_type) || IsStruct(type)) return InlineAlignment(type);
+	return parser.opts.offset_bits / 8;
+}
+
+// Create<Type>Fast writes every field, defaults included, at an offset
+// computed here. The vtable is emitted as a constant, so the builder only
+// has to write it once per buffer and never searches for a duplicate.
+static void GenCreateFast(const Parser &parser, StructDef &struct_def,
+						  std::string *code_ptr) {
+	std::string &code = *code_ptr;
+	std::vector<FieldDef *> fields;
+	for (auto it = struct_def.fields.vec.begin();
+			 it != struct_def.fields.vec.end();
+			 ++it) {
+		if ((*it)->value.type.base_type == BASE_TYPE_UNION) return;
+		if (!(*it)->deprecated) fields.push_back(*it);
+	}
+	// Largest alignment first, right after the vtable offset, which keeps the
+	// padding between fields to a minimum.
+	std::stable_sort(fields.begin(), fields.end(),
+		[&parser](const FieldDef *a, const FieldDef *b) {
+			return FixedFieldAlignment(parser, a->value.type) >
+				   FixedFieldAlignment(parser, b->value.type);
+		});
+	auto numfields = struct_def.fields.vec.size();
+	std::vector<size_t> vtable(numfields + 2, 0);
+	size_t alignment = parser.opts.offset_bits / 8;
+	size_t size = alignment;
+	for (auto it = fields.begin(); it != fields.end(); ++it) {
+		auto &type = (*it)->value.type;
+		auto field_align = FixedFieldAlignment(parser, type);
+		alignment = std::max(alignment, field_align);
+		size += PaddingBytes(size, field_align);
+		vtable[(*it)->value.offset / sizeof(vofs_t)] = size;
+		size += FixedFieldSize(parser, type);
+	}
+	vtable[0] = FieldIndexToOffset(static_cast<vofs_t>(numfields));
+	vtable[1] = size;
+
+	code += "// Every field is written, so all offsets have to be set. Use Create";
+	code += struct_def.name + "\n// when some of them are absent.\n";
+	code += "inline megrez::Offset<" + struct_def.name + "> Create";
+	code += struct_def.name + "Fast(\n\t  megrez::MegrezBuilder &_mb";
+	for (auto it = struct_def.fields.vec.begin();
+			 it != struct_def.fields.vec.end();
+			 ++it) {
+		auto &field = **it;
+		if (field.deprecated) continue;
+		code += ",\n\t  ";
+		if (IsStruct(field.value.type))
+			code += "const " + GenTypePointer(field.value.type) + " &";
+		else
+			code += GenTypeWire(field.value.type, " ");
+		code += field.name;
+	}
+	code += ") {\n\n\tstatic constexpr megrez::vofs_t vtable[] = { ";
+	for (auto it = vtable.begin(); it != vtable.end(); ++it) {
+		if (it != vtable.begin()) code += ", ";
+		code += NumToString(*it);
+	}
+	code += " };\n";
+	code += "\tauto info_ = _mb.ReserveFixedInfo(vtable, ";
+	code += NumToString(alignment) + ");\n";
+	for (auto it = fields.begin(); it != fields.end(); ++it) {
+		auto &field = **it;
+		code += "\t_mb.SetFixed";
+		if (IsScalar(field.value.type.base_type))
+			code += "Field<" + GenTypeWire(field.value.type, "") + ">";
+		else if (IsStruct(field.value.type))
+			code += "Struct";
+		else
+			code += "Offset";
+		code += "(info_, ";
+		code += NumToString(vtable[field.value.offset / sizeof(vofs_t)]);
+		code += ", " + field.name + ");\n";
+	}
+	code += "\treturn megrez::Offset<" + struct_def.name + ">(info_);\n}\n\n";
+}
+
+// Comparisons on the key field, used by CreateVectorOfSortedInfos and
+// Vector::LookupByKey.
+static void GenKeyCompare(StructDef &struct_def, std::string *code_ptr) {
+	if (!struct_def.has_key) return;
+	std::string &code = *code_ptr;
+	for (auto it = struct_def.fields.vec.begin();
+			 it != struct_def.fields.vec.end();
+			 ++it) {
+		auto &field = **it;
+		if (!field.key) continue;
+		auto &type = field.value.type;
+		code += "\tbool KeyCompareLessThan(const " + struct_def.name;
+		code += " *o) const ";
+		if (IsString(type.base_type)) {
+			code += "{\n\t\tauto key = o->" + field.name + "();\n";
+			code += "\t\treturn KeyCompareWithValue(key ? key->view() : ";
+			code += "megrez::StringRef()) < 0;\n\t}\n";
+			code += "\tint KeyCompareWithValue(megrez::StringRef val) const {\n";
+			code += "\t\tauto key = " + field.name + "();\n";
+			code += "\t\treturn (key ? key->view() : megrez::StringRef()).compare(val);\n";
+		} else {
+			code += "{ return " + field.name + "() < o->" + field.name + "(); }\n";
+			code += "\tint KeyCompareWithValue(" + GenTypeBasic(type);
+			code += " val) const {\n";
+			code += "\t\tauto key = " + field.name + "();\n";
+			code += "\t\treturn static_cast<int>(key > val) - static_cast<int>(key < val);\n";
+		}
+		code += "\t}\n";
+	}
+}
+
+// Verify() member of an info: its vtable, every field present, and the
+// objects the fields refer to.
+static void GenVerify(StructDef &struct_def, std::string *code_ptr) {
+	std::string &code = *code_ptr;
+	code += "\tbool Verify(megrez::Verifier &verifier) const {\n";
+	code += "\t\treturn VerifyInfoStart(verifier)";
+	for (auto it = struct_def.fields.vec.begin();
+			 it != struct_def.fields.vec.end();
+			 ++it) {
+		auto &field = **it;
+		if (field.deprecated) continue;
+		auto &type = field.value.type;
+		auto offset = NumToString(field.value.offset);
+		if (IsScalar(type.base_type) || IsStruct(type)) {
+			code += " &&\n\t\t\tVerifyField<" + GenTypeGet(type, "", "", "");
+			code += ">(verifier, " + offset + ")";
+			continue;
+		}
+		code += " &&\n\t\t\tVerifyOffset(verifier, " + offset + ")";
+		auto accessor = field.name + "()";
+		switch (type.base_type) {
+			case BASE_TYPE_STRING:
+				code += " && verifier.VerifyString(" + accessor + ")";
+				break;
+			case BASE_TYPE_VECTOR:
+				code += " && verifier.VerifyVector(" + accessor + ")";
+				if (type.element == BASE_TYPE_STRING)
+					code += " &&\n\t\t\tverifier.VerifyVectorOfStrings(" + accessor + ")";
+				else if (type.element == BASE_TYPE_STRUCT && !type.struct_def->fixed)
+					code += " &&\n\t\t\tverifier.VerifyVectorOfInfos(" + accessor + ")";
+				break;
+			case BASE_TYPE_STRUCT:
+				code += " && verifier.VerifyInfo(" + accessor + ")";
+				break;
+			case BASE_TYPE_MAP:
+				code += " && verifier.VerifyMap(" + accessor + ")";
+				break;
+			case BASE_TYPE_UNION:
+				code += " &&\n\t\t\t" + GenUnionVerifyName(*type.enum_def) + "(verifier, ";
+				code += accessor + ", " + field.name + "_type())";
+				break;
+			default:
+				break;
+		}
+	}
+	code += " &&\n\t\t\tverifier.EndInfo();\n\t}\n";
+}
+
+// In place setters of an info field: scalars are overwritten if present,
+// structs, vectors and infos are handed out as mutable pointers.
+static void GenMutator(const Parser &parser, const FieldDef &field, std::string *code_ptr) {
+	std::string &code = *code_ptr;
+	auto &type = field.value.type;
+	auto offset = NumToString(field.value.offset);
+	if (IsScalar(type.base_type)) {
+		code += "\tbool mutate_" + field.name + "(" + GenTypeWire(type, " ");
+		code += field.name + ") { return SetField<" + GenTypeWire(type, "");
+		code += GenReadPolicy(parser) + ">(" + offset + ", " + field.name + "); }\n";
+		return;
+	}
+	if (type.base_type != BASE_TYPE_VECTOR && type.base_type != BASE_TYPE_STRUCT) return;
+	auto pointer = GenTypeRead(parser, type) + " *";
+	code += "\t" + pointer + "mutable_" + field.name + "() { return ";
+	code += IsStruct(type) ? "GetMutableStruct<" : "GetMutablePointer<";
+	code += pointer + GenReadPolicy(parser) + ">(" + offset + "); }\n";
+}
+
+// Object API: a native <Type>T per info, unpacked from and packed into
+// buffers. The type field of a union is the tag of its ObjUnion member.
+static bool IsObjectField(const FieldDef &field) {
+	return !field.deprecated && field.value.type.base_type != BASE_TYPE_UTYPE;
+}
+
+// A switch on the tag of a union member, with `body` giving the statement
+// for each type of the union from its tag and info type name.
+template<typename F>
+static void GenUnionSwitch(const Type &type, const std::string &tag, const std::string &indent,
+						   F body, std::string *code_ptr) {
+	std::string &code = *code_ptr;
+	auto &vals = type.enum_def->vals.vec;
+	code += indent + "switch (" + tag + ") {\n";
+	for (auto it = vals.begin() + 1; it != vals.end(); ++it) {
+		auto name = GenTypeName(*type.enum_def) + "_" + (*it)->name;
+		code += indent + "\tcase " + name + ":\n";
+		code += indent + "\t\t" + body(name, GenTypeName(*(*it)->struct_def)) + ";\n";
+		code += indent + "\t\tbreak;\n";
+	}
+	code += indent + "\tdefault:\n" + indent + "\t\tbreak;\n" + indent + "}\n";
+}
+
+static std::string GenObjectType(const Type &type, bool element = false) {
+	switch (type.base_type) {
+		case BASE_TYPE_STRING:
+			return "megrez::ObjString";
+		case BASE_TYPE_VECTOR:
+			return "megrez::ObjVector<" + GenObjectType(type.VectorType(), true) + ">";
+		case BASE_TYPE_STRUCT:
+			if (type.struct_def->fixed)
+				return element ? GenTypeName(*type.struct_def)
+							   : "megrez::ObjPtr<" + GenTypeName(*type.struct_def) + ">";
+			return "megrez::ObjPtr<" + GenTypeName(*type.struct_def) + "T>";
+		case BASE_TYPE_MAP:
+			return "megrez::ObjMap<" + GenObjectType(type.KeyType(), true) + ", " +
+				GenObjectType(type.VectorType(), true) + ">";
+		case BASE_TYPE_UNION:
+			return "megrez::ObjUnion";
+		default:
+			return GenTypeBasic(type);
+	}
+}
+
+static void GenObject(StructDef &struct_def, std::string *code_ptr) {
+	std::string &code = *code_ptr;
+	code += "struct " + struct_def.name + "T {\n";
+	code += "\tmegrez::Allocator *allocator_;\n";
+	std::string init = "allocator_(allocator)";
+	for (auto it = struct_def.fields.vec.begin();
+		 it != struct_def.fields.vec.end();
+		 ++it) {
+		auto &field = **it;
+		if (!IsObjectField(field)) continue;
+		auto &type = field.value.type;
+		code += "\t" + GenObjectType(type) + " " + field.name + ";\n";
+		if (IsScalar(type.base_type))
+			init += ", " + field.name + "(" + field.value.constant + ")";
+		else if (type.base_type == BASE_TYPE_STRING || type.base_type == BASE_TYPE_VECTOR ||
+				 type.base_type == BASE_TYPE_MAP)
+			init += ", " + field.name + "(allocator)";
+	}
+	code += "\n\t// Strings, vectors, maps and child objects come from `allocator`, or the heap.\n";
+	code += "\texplicit " + struct_def.name + "T(megrez::Allocator *allocator = nullptr)\n";
+	code += "\t\t: " + init + " {}\n";
+	code += "};\n\n";
+}
+
+static void GenObjectDecls(StructDef &struct_def, std::string *code_ptr) {
+	std::string &code = *code_ptr;
+	auto &name = struct_def.name;
+	code += "\tmegrez::ObjPtr<" + name + "T> UnPack(megrez::Allocator *allocator = nullptr) const;\n";
+	code += "\tvoid UnPackTo(" + name + "T *_o) const;\n";
+	code += "\tstatic megrez::Offset<" + name + "> Pack(megrez::MegrezBuilder &_mb, const ";
+	code += name + "T &_o);\n";
+	code += "\tstatic size_t PackedSize(const " + name + "T &_o);\n";
 }
-static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
+
+static void GenObjectFuncs(const Parser &parser, StructDef &struct_def, std::string *code_ptr) {
 	if (struct_def.generated) return;
 	std::string &code = *code_ptr;
+	auto &name = struct_def.name;
+	auto &fields = struct_def.fields.vec;
+
+	code += "inline megrez::ObjPtr<" + name + "T> " + name;
+	code += "::UnPack(megrez::Allocator *allocator) const {\n";
+	code += "\tauto _o = megrez::MakeObj<" + name + "T>(allocator, allocator);\n";
+	code += "\tUnPackTo(_o.get());\n\treturn _o;\n}\n\n";
+
+	code += "inline void " + name + "::UnPackTo(" + name + "T *_o) const {\n";
+	for (auto it = fields.begin(); it != fields.end(); ++it) {
+		auto &field = **it;
+		if (!IsObjectField(field)) continue;
+		auto &type = field.value.type;
+		auto member = "_o->" + field.name;
+		auto getter = field.name + "()";
+		switch (type.base_type) {
+			case BASE_TYPE_STRING:
+				code += "\tif (auto _e = " + getter + ") " + member;
+				code += ".assign(_e->c_str(), _e->Length());\n\telse " + member + ".clear();\n";
+				break;
+			case BASE_TYPE_STRUCT:
+				code += "\tif (auto _e = " + getter + ") " + member + " = ";
+				code += type.struct_def->fixed
+					? "megrez::MakeObj<" + GenTypeName(*type.struct_def) + ">(_o->allocator_, *_e);\n"
+					: "_e->UnPack(_o->allocator_);\n";
+				code += "\telse " + member + ".reset();\n";
+				break;
+			case BASE_TYPE_VECTOR: {
+				auto element = type.VectorType();
+				std::string value = "_i";
+				if (element.base_type == BASE_TYPE_STRING)
+					value = "megrez::ObjString(_i->c_str(), _i->Length(), " + member + ".get_allocator())";
+				else if (element.base_type == BASE_TYPE_STRUCT && !element.struct_def->fixed)
+					value = "_i->UnPack(_o->allocator_)";
+				code += "\t" + member + ".clear();\n";
+				code += "\tif (auto _e = " + getter + ") {\n";
+				code += "\t\t" + member + ".reserve(_e->size());\n";
+				code += "\t\tfor (auto _i : *_e) " + member + ".push_back(" + value + ");\n";
+				code += "\t}\n";
+				break;
+			}
+			case BASE_TYPE_MAP: {
+				auto key = std::string("_keys->Get(_i)");
+				if (type.key == BASE_TYPE_STRING)
+					key = "megrez::ObjString(" + key + "->c_str(), " + key + "->Length(), _o->allocator_)";
+				auto element = type.VectorType();
+				auto value = std::string("_values->Get(_i)");
+				if (element.base_type == BASE_TYPE_STRING)
+					value = "megrez::ObjString(" + value + "->c_str(), " + value +
+						"->Length(), _o->allocator_)";
+				else if (element.base_type == BASE_TYPE_STRUCT && !element.struct_def->fixed)
+					value += "->UnPack(_o->allocator_)";
+				code += "\t" + member + ".clear();\n";
+				code += "\tif (auto _e = " + getter + ") {\n";
+				code += "\t\tauto _keys = _e->keys();\n\t\tauto _values = _e->values();\n";
+				code += "\t\t" + member + ".reserve(_keys->size());\n";
+				code += "\t\tfor (megrez::uofs_t _i = 0; _i < _keys->size(); _i++)\n";
+				code += "\t\t\t" + member + ".emplace_back(\n\t\t\t\t" + key + ",\n\t\t\t\t" + value + ");\n";
+				code += "\t}\n";
+				break;
+			}
+			case BASE_TYPE_UNION:
+				code += "\t" + member + ".Reset();\n";
+				code += "\tif (auto _e = " + getter + ") {\n";
+				GenUnionSwitch(type, field.name + "_type()", "\t\t",
+					[&](const std::string &tag, const std::string &info) {
+						return member + ".Set(" + tag + ", static_cast<const " + info +
+							" *>(_e)->UnPack(_o->allocator_))";
+					}, code_ptr);
+				code += "\t}\n";
+				break;
+			default:
+				code += "\t" + member + " = " + getter + ";\n";
+				break;
+		}
+	}
+	code += "}\n\n";
+
+	code += "inline megrez::Offset<" + name + "> " + name;
+	code += "::Pack(megrez::MegrezBuilder &_mb, const " + name + "T &_o) {\n";
+	std::string args;
+	for (auto it = fields.begin(); it != fields.end(); ++it) {
+		auto &field = **it;
+		if (field.deprecated) continue;
+		auto &type = field.value.type;
+		auto member = "_o." + field.name;
+		if (type.base_type == BASE_TYPE_UTYPE) {
+			// The tag of the union right after it.
+			auto &value = **(it + 1);
+			args += ", " + (value.deprecated ? field.value.constant : "_o." + value.name + ".type");
+			continue;
+		}
+		if (IsScalar(type.base_type)) {
+			args += ", " + member;
+			continue;
+		}
+		if (IsStruct(type)) {
+			args += ", " + member + ".get()";
+			continue;
+		}
+		auto local = "_" + field.name;
+		args += ", " + local;
+		code += "\t" + GenTypeWire(type, " ") + local + ";\n";
+		if (type.base_type == BASE_TYPE_UNION) {
+			code += "\tif (" + member + ".get()) {\n";
+			GenUnionSwitch(type, member + ".type", "\t\t",
+				[&](const std::string &, const std::string &info) {
+					return local + " = " + info + "::Pack(_mb, *" + member + ".As<" + info +
+						"T>()).Union()";
+				}, code_ptr);
+			code += "\t}\n";
+			continue;
+		}
+		switch (type.base_type) {
+			case BASE_TYPE_STRING:
+				code += "\tif (" + member + ".size()) " + local + " = _mb.CreateString(";
+				code += member + ".data(), " + member + ".size());\n";
+				break;
+			case BASE_TYPE_STRUCT:
+				code += "\tif (" + member + ") " + local + " = " + GenTypeName(*type.struct_def);
+				code += "::Pack(_mb, *" + member + ");\n";
+				break;
+			case BASE_TYPE_VECTOR: {
+				auto element = type.VectorType();
+				code += "\tif (" + member + ".size()) {\n";
+				if (IsScalar(element.base_type)) {
+					code += "\t\t" + local + " = _mb.CreateVector(" + member + ".data(), ";
+					code += member + ".size());\n";
+				} else if (IsStruct(element)) {
+					code += "\t\t" + local + " = _mb.CreateVectorOfStructs(" + member + ".data(), ";
+					code += member + ".size());\n";
+				} else {
+					code += "\t\tstd::vector<" + GenTypeWire(element, "") + "> _v(";
+					code += member + ".size());\n";
+					code += "\t\tfor (size_t _i = 0; _i < _v.size(); _i++)\n\t\t\t_v[_i] = ";
+					if (element.base_type == BASE_TYPE_STRING)
+						code += "_mb.CreateString(" + member + "[_i].data(), " + member + "[_i].size());\n";
+					else
+						code += GenTypeName(*element.struct_def) + "::Pack(_mb, *" + member + "[_i]);\n";
+					code += "\t\t" + local + " = ";
+					code += element.base_type == BASE_TYPE_STRUCT && element.struct_def->has_key
+						? "_mb.CreateVectorOfSortedInfos(&_v);\n" : "_mb.CreateVector(_v);\n";
+				}
+				code += "\t}\n";
+				break;
+			}
+			case BASE_TYPE_MAP: {
+				auto element = type.VectorType();
+				auto key = std::string("_e.first");
+				if (type.key == BASE_TYPE_STRING)
+					key = "_mb.CreateString(" + key + ".data(), " + key + ".size())";
+				auto value = std::string("_e.second");
+				if (element.base_type == BASE_TYPE_STRING)
+					value = "_mb.CreateString(" + value + ".data(), " + value + ".size())";
+				else if (element.base_type == BASE_TYPE_STRUCT && !element.struct_def->fixed)
+					value = GenTypeName(*element.struct_def) + "::Pack(_mb, *" + value + ")";
+				code += "\tif (" + member + ".size()) {\n";
+				code += "\t\tstd::vector<" + GenTypeWire(type.KeyType(), "") + "> _k;\n";
+				code += "\t\tstd::vector<" + (IsStruct(element)
+					? GenTypeName(*element.struct_def) : GenTypeWire(element, "")) + "> _v;\n";
+				code += "\t\t_k.reserve(" + member + ".size());\n";
+				code += "\t\t_v.reserve(" + member + ".size());\n";
+				code += "\t\tfor (auto &_e : " + member + ") {\n";
+				code += "\t\t\t_k.push_back(" + key + ");\n";
+				code += "\t\t\t_v.push_back(" + value + ");\n\t\t}\n";
+				code += "\t\t" + local + " = ";
+				code += IsStruct(element)
+					? "_mb.CreateMapOfStructs(_k.data(), _v.data(), _k.size());\n"
+					: "_mb.CreateMap(_k, _v);\n";
+				code += "\t}\n";
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	code += "\treturn Create" + name + "(_mb" + args + ");\n}\n\n";
+
+	// The info itself: vtable, soffset, fields and their padding.
+	size_t info_size = 2 * parser.opts.offset_bits / 8 + sizeof(max_scalar_t);
+	for (auto it = fields.begin(); it != fields.end(); ++it) {
+		info_size += FixedFieldSize(parser, (*it)->value.type) +
+			FixedFieldAlignment(parser, (*it)->value.type);
+	}
+	code += "inline size_t " + name + "::PackedSize(const " + name + "T &_o) {\n";
+	code += "\tsize_t _size = " + NumToString(fields.size() + 2) + " * sizeof(megrez::vofs_t) + ";
+	code += NumToString(info_size) + ";\n";
+	for (auto it = fields.begin(); it != fields.end(); ++it) {
+		auto &field = **it;
+		if (!IsObjectField(field)) continue;
+		auto &type = field.value.type;
+		auto member = "_o." + field.name;
+		switch (type.base_type) {
+			case BASE_TYPE_STRING:
+				code += "\t_size += megrez::PackedStringSize(" + member + ".size());\n";
+				break;
+			case BASE_TYPE_STRUCT:
+				if (!type.struct_def->fixed)
+					code += "\tif (" + member + ") _size += " + GenTypeName(*type.struct_def) +
+						"::PackedSize(*" + member + ");\n";
+				break;
+			case BASE_TYPE_VECTOR: {
+				auto element = type.VectorType();
+				auto elemsize = IsScalar(element.base_type) || IsStruct(element)
+					? "sizeof(" + GenObjectType(element, true) + ")"
+					: std::string("sizeof(megrez::uofs_t)");
+				code += "\t_size += megrez::PackedVectorSize(" + member + ".size(), ";
+				code += elemsize + ");\n";
+				if (element.base_type == BASE_TYPE_STRING)
+					code += "\tfor (auto &_e : " + member +
+						") _size += megrez::PackedStringSize(_e.size());\n";
+				else if (element.base_type == BASE_TYPE_STRUCT && !element.struct_def->fixed)
+					code += "\tfor (auto &_e : " + member + ") _size += " +
+						GenTypeName(*element.struct_def) + "::PackedSize(*_e);\n";
+				break;
+			}
+			case BASE_TYPE_MAP: {
+				auto element = type.VectorType();
+				auto keysize = type.key == BASE_TYPE_STRING
+					? std::string("sizeof(megrez::uofs_t)")
+					: "sizeof(" + GenTypeBasic(type.KeyType()) + ")";
+				auto valuesize = IsScalar(element.base_type) || IsStruct(element)
+					? "sizeof(" + GenObjectType(element, true) + ")"
+					: std::string("sizeof(megrez::uofs_t)");
+				code += "\t_size += megrez::PackedMapSize(" + member + ".size(), " + keysize;
+				code += ", " + valuesize + ");\n";
+				std::string entry;
+				if (type.key == BASE_TYPE_STRING)
+					entry += " + megrez::PackedStringSize(_e.first.size())";
+				if (element.base_type == BASE_TYPE_STRING)
+					entry += " + megrez::PackedStringSize(_e.second.size())";
+				else if (element.base_type == BASE_TYPE_STRUCT && !element.struct_def->fixed)
+					entry += " + " + GenTypeName(*element.struct_def) + "::PackedSize(*_e.second)";
+				if (entry.size())
+					code += "\tfor (auto &_e : " + member + ") _size +=" + entry.substr(2) + ";\n";
+				break;
+			}
+			case BASE_TYPE_UNION:
+				code += "\tif (" + member + ".get()) {\n";
+				GenUnionSwitch(type, member + ".type", "\t\t",
+					[&](const std::string &, const std::string &info) {
+						return "_size += " + info + "::PackedSize(*" + member + ".As<" + info + "T>())";
+					}, code_ptr);
+				code += "\t}\n";
+				break;
+			default:
+				break;
+		}
+	}
+	code += "\treturn _size;\n}\n\n";
+}
+
+static void GenInfo(const Parser &parser, StructDef &struct_def, std::string *code_ptr) {
+	if (struct_def.generated) return;
+	std::string &code = *code_ptr;
+	if (parser.opts.generate_object_api) GenObject(struct_def, code_ptr);
 	GenComment(struct_def.doc_comment, code_ptr);
 	code += "struct " + struct_def.name + " : private megrez::Info";
 	code += " {\n";
@@ -120,20 +721,25 @@ static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
 		auto &field = **it;
 		if (!field.deprecated) {  // Deprecated fields won't be accessible.
 			GenComment(field.doc_comment, code_ptr, "\t");
-			code += "\t" + GenTypeGet(field.value.type, " ", "const ", " *");
+			code += "\t" + GenTypeGetRead(parser, field.value.type, " ", "const ", " *");
 			code += field.name + "() const { return ";
 			// Call a different accessor for pointers, that indirects.
 			code += IsScalar(field.value.type.base_type)
 				? "GetField<"
 				: (IsStruct(field.value.type) ? "GetStruct<" : "GetPointer<");
-			code += GenTypeGet(field.value.type, "", "const ", " *") + ">(";
+			code += GenTypeGetRead(parser, field.value.type, "", "const ", " *");
+			code += GenReadPolicy(parser) + ">(";
 			code += NumToString(field.value.offset);
 			// Default value as second arg for non-pointer types.
 			if (IsScalar(field.value.type.base_type))
 				code += ", " + field.value.constant;
 			code += "); }\n";
+			if (parser.opts.generate_mutable) GenMutator(parser, field, code_ptr);
 		}
 	}
+	GenKeyCompare(struct_def, code_ptr);
+	GenVerify(struct_def, code_ptr);
+	if (parser.opts.generate_object_api) GenObjectDecls(struct_def, code_ptr);
 	code += "};\n\n";
 	code += "struct " + struct_def.name;
 	code += "Builder {\n\tmegrez::MegrezBuilder &mb_;\n";
@@ -156,13 +762,9 @@ static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
 				code += ", " + field.value.constant;
 			code += "); }\n";
 			if (IsString(field.value.type.base_type)) {
-				code += "\tvoid add_" + field.name + "(std::string " + field.name + ") { \n\t";
-				code += "\tmegrez::MegrezBuilder b;\n\t";
-				code += "\tmegrez::Offset<megrez::String> " + field.name + "_";
-				code += " = b.CreateString(" + field.name + ");\n\t";
-				code += "\tmb_.AddOffset(" + NumToString(field.value.offset) + ", ";
-				code += field.name + "_);\n\t";
-				code += "}\n";
+				code += "\tvoid add_" + field.name + "(megrez::StringRef " + field.name;
+				code += ") { mb_.AddOffset(" + NumToString(field.value.offset);
+				code += ", mb_.CreateString(" + field.name + ")); }\n";
 			}
 		}
 	}
@@ -172,6 +774,10 @@ static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
 	code += "\tmegrez::Offset<" + struct_def.name;
 	code += "> Finish() { return megrez::Offset<" + struct_def.name;
 	code += ">(mb_.EndInfo(start_, ";
+	code += NumToString(struct_def.fields.vec.size()) + ")); }\n";
+	code += "\tmegrez::Offset<" + struct_def.name;
+	code += "> FinishShared() { return megrez::Offset<" + struct_def.name;
+	code += ">(mb_.EndSharedInfo(start_, ";
 	code += NumToString(struct_def.fields.vec.size()) + ")); }\n};\n\n";
 
 
@@ -200,7 +806,7 @@ static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
 			auto &field = **it;
 			if (!field.deprecated &&
 					(!struct_def.sortbysize ||
-					 size == SizeOf(field.value.type.base_type))) {
+					 size == FieldSize(parser, field.value.type))) {
 				code += "\tbuilder_.add_" + field.name + "(" + field.name + ");\n";
 			}
 		}
@@ -220,10 +826,21 @@ static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
 				code += ",\n\t  " + GenTypeWire(field.value.type, " ") + field.name;
 			}
 			if (!field.deprecated && IsString(field.value.type.base_type)) {
-				code += ",\n\t  std::string " + field.name; 
+				code += ",\n\t  megrez::StringRef " + field.name;
 			}
 		}
-		code += ") {\n\n\t" + struct_def.name + "Builder builder_(_mb);\n";
+		code += ") {\n\n";
+		// Write the strings first, so they don't end up inside the info.
+		for (auto it = struct_def.fields.vec.begin();
+				 it != struct_def.fields.vec.end();
+				 ++it) {
+			auto &field = **it;
+			if (!field.deprecated && IsString(field.value.type.base_type)) {
+				code += "\tauto " + field.name + "_ = _mb.CreateString(";
+				code += field.name + ");\n";
+			}
+		}
+		code += "\t" + struct_def.name + "Builder builder_(_mb);\n";
 		for (size_t size = struct_def.sortbysize ? sizeof(max_scalar_t) : 1;
 				 size;
 				 size /= 2) {
@@ -233,23 +850,29 @@ static void GenInfo(StructDef &struct_def, std::string *code_ptr) {
 				auto &field = **it;
 				if (!field.deprecated &&
 						(!struct_def.sortbysize ||
-						 size == SizeOf(field.value.type.base_type))) {
-					code += "\tbuilder_.add_" + field.name + "(" + field.name + ");\n";
+						 size == FieldSize(parser, field.value.type))) {
+					code += "\tbuilder_.add_" + field.name + "(" + field.name;
+					if (IsString(field.value.type.base_type)) code += "_";
+					code += ");\n";
 				}
 			}
 		}
 		code += "\treturn builder_.Finish();\n}\n\n";
 	}
 
-
+	GenCreateFast(parser, struct_def, code_ptr);
 }
 
 // Generate an accessor struct with constructor for a megrez struct.
-static void GenStruct(StructDef &struct_def, std::string *code_ptr) {
+static void GenStruct(const Parser &parser, StructDef &struct_def, std::string *code_ptr) {
 	if (struct_def.generated) return;
 	std::string &code = *code_ptr;
 	GenComment(struct_def.doc_comment, code_ptr);
-	code += "MANUALLY_ALIGNED_STRUCT(" + NumToString(struct_def.minalign) + ") ";
+	// Unaligned accessors may find the struct anywhere, so only the builder
+	// gets to see its real alignment.
+	auto unaligned = parser.opts.unaligned_reads;
+	code += "MANUALLY_ALIGNED_STRUCT(";
+	code += (unaligned ? "1" : NumToString(struct_def.minalign)) + ") ";
 	code += struct_def.name + " {\n private:\n";
 	int padding_id = 0;
 	for (auto it = struct_def.fields.vec.begin();
@@ -266,7 +889,12 @@ static void GenStruct(StructDef &struct_def, std::string *code_ptr) {
 			assert(!(field.padding & ~0xF));
 		}
 	}
-	code += "\n public:\n\t" + struct_def.name + "(";
+	code += "\n public:\n";
+	if (unaligned) {
+		code += "\tstatic const size_t kBufferAlignment = ";
+		code += NumToString(struct_def.minalign) + ";\n\n";
+	}
+	code += "\t" + struct_def.name + "(";
 	for (auto it = struct_def.fields.vec.begin();
 			 it != struct_def.fields.vec.end();
 			 ++it) {
@@ -297,11 +925,25 @@ static void GenStruct(StructDef &struct_def, std::string *code_ptr) {
 		GenComment(field.doc_comment, code_ptr, "\t");
 		code += "\t" + GenTypeGet(field.value.type, " ", "const ", " &");
 		code += field.name + "() const { return ";
-		if (IsScalar(field.value.type.base_type))
+		if (IsScalar(field.value.type.base_type) && parser.opts.unaligned_reads)
+			code += "megrez::ReadScalar<" + GenTypeBasic(field.value.type) +
+				GenReadPolicy(parser) + ">(&" + field.name + "_)";
+		else if (IsScalar(field.value.type.base_type))
 			code += "megrez::EndianScalar(" + field.name + "_)";
 		else
 			code += field.name + "_";
 		code += "; }\n";
+		if (!parser.opts.generate_mutable) continue;
+		if (IsScalar(field.value.type.base_type)) {
+			code += "\tvoid mutate_" + field.name + "(" + GenTypeBasic(field.value.type);
+			code += " " + field.name + ") { megrez::WriteScalar";
+			if (parser.opts.unaligned_reads)
+				code += "<" + GenTypeBasic(field.value.type) + GenReadPolicy(parser) + ">";
+			code += "(&" + field.name + "_, " + field.name + "); }\n";
+		} else {
+			code += "\t" + GenTypeGet(field.value.type, " ", "", " &");
+			code += "mutable_" + field.name + "() { return " + field.name + "_; }\n";
+		}
 	}
 	code += "};\nSTRUCT_END(" + struct_def.name + ", ";
 	code += NumToString(struct_def.bytesize) + ");\n\n";
@@ -319,27 +961,54 @@ std::string GenerateCPP(const Parser &parser) {
 	std::string forward_decl_code;
 	for (auto it = parser.structs_.vec.begin();
 			 it != parser.structs_.vec.end(); ++it) {
-		if (!(*it)->generated)
+		if (!(*it)->generated) {
 			forward_decl_code += "struct " + (*it)->name + ";\n";
+			if (parser.opts.generate_object_api && !(*it)->fixed)
+				forward_decl_code += "struct " + (*it)->name + "T;\n";
+		}
 	}
 	std::string decl_code;
 	for (auto it = parser.structs_.vec.begin();
 			 it != parser.structs_.vec.end(); ++it) {
-		if ((**it).fixed) GenStruct(**it, &decl_code);
+		if ((**it).fixed) GenStruct(parser, **it, &decl_code);
 	}
 	for (auto it = parser.structs_.vec.begin();
 			 it != parser.structs_.vec.end(); ++it) {
-		if (!(**it).fixed) GenInfo(**it, &decl_code);
+		if (!(**it).fixed) GenInfo(parser, **it, &decl_code);
+	}
+	for (auto it = parser.enums_.vec.begin(); it != parser.enums_.vec.end(); ++it)
+		GenUnionVerify(**it, &decl_code);
+	if (parser.opts.generate_object_api) {
+		for (auto it = parser.structs_.vec.begin();
+				 it != parser.structs_.vec.end(); ++it) {
+			if (!(**it).fixed) GenObjectFuncs(parser, **it, &decl_code);
+		}
 	}
-	if (enum_code.length() || forward_decl_code.length() || decl_code.length()) {
+	if (enum_code.length() || forward_decl_code.length() || decl_code.length() ||
+		parser.includes_.size()) {
 		std::string code;
+		auto offset_bits = NumToString(parser.opts.offset_bits);
 		code = "// Automatically generated by MegrezCompiler, DO NOT MODIFY!\n\n";
+		if (parser.opts.offset_bits != 32) {
+			code += "#ifndef MEGREZ_OFFSET_BITS\n";
+			code += "\t#define MEGREZ_OFFSET_BITS " + offset_bits + "\n";
+			code += "#endif\n\n";
+		}
 		code += "#include <megrez/basic.h>\n";
 		code += "#include <megrez/builder.h>\n";
 		code += "#include <megrez/info.h>\n";
+		code += "#include <megrez/map.h>\n";
+		if (parser.opts.generate_object_api) code += "#include <megrez/object.h>\n";
 		code += "#include <megrez/string.h>\n";
 		code += "#include <megrez/struct.h>\n";
-		code += "#include <megrez/vector.h>\n\n";
+		code += "#include <megrez/vector.h>\n";
+		code += "#include <megrez/verifier.h>\n\n";
+		for (auto it = parser.includes_.begin(); it != parser.includes_.end(); ++it)
+			code += "#include \"" + StripExtension(*it) + ".mgz.h\"\n";
+		if (parser.includes_.size()) code += "\n";
+		code += "static_assert(MEGREZ_OFFSET_BITS == " + offset_bits + ",\n";
+		code += "\t\"generated for " + offset_bits + "-bit offsets, ";
+		code += "define MEGREZ_OFFSET_BITS accordingly\");\n\n";
 
 		for (auto it = parser.name_space_.begin();
 				 it != parser.name_space_.end(); ++it) {
@@ -354,7 +1023,33 @@ std::string GenerateCPP(const Parser &parser) {
 			code += "inline const " + parser.main_struct_def->name + " *Get";
 			code += parser.main_struct_def->name;
 			code += "(const void *buf) { return megrez::GetRoot<";
-			code += parser.main_struct_def->name + ">(buf); }\n\n";
+			code += parser.main_struct_def->name + GenReadPolicy(parser) + ">(buf); }\n\n";
+			code += "inline const " + parser.main_struct_def->name + " *GetSizePrefixed";
+			code += parser.main_struct_def->name;
+			code += "(const void *buf) { return megrez::GetSizePrefixedRoot<";
+			code += parser.main_struct_def->name + GenReadPolicy(parser) + ">(buf); }\n\n";
+			if (parser.opts.generate_object_api) {
+				auto &name = parser.main_struct_def->name;
+				code += "inline megrez::ObjPtr<" + name + "T> UnPack" + name;
+				code += "(const void *buf, megrez::Allocator *allocator = nullptr) {\n";
+				code += "\treturn Get" + name + "(buf)->UnPack(allocator);\n}\n\n";
+				code += "inline void Finish" + name + "Buffer(megrez::MegrezBuilder &_mb, const ";
+				code += name + "T &_o) {\n";
+				code += "\t_mb.Reserve(" + name + "::PackedSize(_o) + 2 * sizeof(megrez::max_scalar_t));\n";
+				code += "\t_mb.Finish(" + name + "::Pack(_mb, _o));\n}\n\n";
+			}
+			if (parser.opts.generate_mutable) {
+				code += "inline " + parser.main_struct_def->name + " *GetMutable";
+				code += parser.main_struct_def->name;
+				code += "(void *buf) { return megrez::GetMutableRoot<";
+				code += parser.main_struct_def->name + GenReadPolicy(parser) + ">(buf); }\n\n";
+			}
+			code += "inline bool Verify" + parser.main_struct_def->name;
+			code += "Buffer(megrez::Verifier &verifier) { return verifier.VerifyBuffer<";
+			code += parser.main_struct_def->name + ">(); }\n\n";
+			code += "inline bool VerifySizePrefixed" + parser.main_struct_def->name;
+			code += "Buffer(megrez::Verifier &verifier) {\n\treturn verifier.";
+			code += "VerifySizePrefixedBuffer<" + parser.main_struct_def->name + ">();\n}\n\n";
 		}
 		for (auto it = parser.name_space_.begin();
 				 it != parser.name_space_.end(); ++it) {
@@ -369,8 +1064,18 @@ std::string GenerateCPP(const Parser &parser) {
 
 bool GenerateCPP(const Parser &parser, const std::string &path, const std::string &file_name) {
 	auto code = GenerateCPP(parser);
-	return !code.length() ||
-			SaveFile((path + file_name + ".mgz.h").c_str(), code, false);
+	if (!code.length()) return true;
+	// Headers include the headers of the files their schema includes, so
+	// they are guarded against being included twice.
+	std::string guard = "MEGREZ_GENERATED_";
+	for (auto it = parser.name_space_.begin(); it != parser.name_space_.end(); ++it)
+		guard += *it + "_";
+	guard += file_name.substr(StripFileName(file_name).size()) + "_MGZ_H_";
+	for (auto it = guard.begin(); it != guard.end(); ++it)
+		*it = isalnum(static_cast<unsigned char>(*it)) ? static_cast<char>(toupper(*it)) : '_';
+	code.insert(code.find("\n\n") + 2, "#ifndef " + guard + "\n#define " + guard + "\n\n");
+	code += "#endif  // " + guard + "\n";
+	return SaveFileIfChanged((path + file_name + ".mgz.h").c_str(), code, false);
 }
 
 }  // namespace megrez
\ No newline at end of file
@@ -0,0 +1,155 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#include <algorithm>
+#include <map>
+#include "megrez/basic.h"
+#include "megrez/reflection.mgz.h"
+#include "megrez/util.h"
+#include "compiler/idl.h"
+
+namespace megrez {
+namespace schema {
+
+#define MEGREZ_CHECK_BASE_TYPE(ENUM, NAME) \
+	static_assert(static_cast<int>(BASE_TYPE_ ## ENUM) == \
+				  static_cast<int>(reflection::BaseType_ ## NAME), \
+				  "reflection.mgz and idl.h disagree on BaseType " #NAME);
+MEGREZ_CHECK_BASE_TYPE(UTYPE, UType)
+MEGREZ_CHECK_BASE_TYPE(BOOL, Bool)
+MEGREZ_CHECK_BASE_TYPE(DOUBLE, Double)
+MEGREZ_CHECK_BASE_TYPE(STRUCT, Obj)
+MEGREZ_CHECK_BASE_TYPE(MAP, Map)
+#undef MEGREZ_CHECK_BASE_TYPE
+
+// Writes the StructDefs and EnumDefs of a parser as a reflection::Schema.
+// Objects, enums and fields are stored in the order of their names, so
+// they can be looked up with LookupByKey.
+class SchemaWriter {
+ public:
+	SchemaWriter(const Parser &parser, MegrezBuilder &mb) : parser_(parser), mb_(mb) {}
+
+	void Write() {
+		auto structs = ByName(parser_.structs_.vec);
+		auto enums = ByName(parser_.enums_.vec);
+		for (size_t i = 0; i < structs.size(); i++) index_[structs[i]] = static_cast<int>(i);
+		for (size_t i = 0; i < enums.size(); i++) index_[enums[i]] = static_cast<int>(i);
+
+		std::vector<Offset<reflection::Object>> objects;
+		for (auto it = structs.begin(); it != structs.end(); ++it)
+			objects.push_back(WriteObject(**it));
+		std::vector<Offset<reflection::Enum>> enum_offsets;
+		for (auto it = enums.begin(); it != enums.end(); ++it)
+			enum_offsets.push_back(WriteEnum(**it));
+
+		std::string name_space;
+		for (auto it = parser_.name_space_.begin(); it != parser_.name_space_.end(); ++it)
+			name_space += (name_space.empty() ? "" : ".") + *it;
+		auto objects_vec = mb_.CreateVector(objects);
+		auto enums_vec = mb_.CreateVector(enum_offsets);
+		auto name_space_str = mb_.CreateString(name_space);
+		mb_.Finish(reflection::CreateSchema(mb_, objects_vec, enums_vec, name_space_str,
+											Index(parser_.main_struct_def)));
+	}
+
+ private:
+	const Parser &parser_;
+	MegrezBuilder &mb_;
+	std::map<const Definition *, int> index_;
+
+	template<typename T>
+	static std::vector<const T *> ByName(const std::vector<T *> &defs) {
+		std::vector<const T *> sorted(defs.begin(), defs.end());
+		std::sort(sorted.begin(), sorted.end(),
+				  [](const T *a, const T *b) { return a->name < b->name; });
+		return sorted;
+	}
+
+	int Index(const Definition *def) const {
+		auto it = index_.find(def);
+		return it == index_.end() ? -1 : it->second;
+	}
+
+	Offset<String> Doc(const Definition &def) {
+		return def.doc_comment.empty() ? Offset<String>() : mb_.CreateString(def.doc_comment);
+	}
+
+	Offset<reflection::Type> WriteType(const Type &type) {
+		auto index = type.struct_def ? Index(type.struct_def) : Index(type.enum_def);
+		return reflection::CreateType(mb_, static_cast<uint8_t>(type.base_type),
+									  static_cast<uint8_t>(type.element),
+									  static_cast<uint8_t>(type.key), index);
+	}
+
+	Offset<reflection::Field> WriteField(const FieldDef &field, uint16_t id) {
+		auto name = mb_.CreateString(field.name);
+		auto type = WriteType(field.value.type);
+		auto doc = Doc(field);
+		auto base_type = field.value.type.base_type;
+		return reflection::CreateField(
+			mb_, name, type, id, static_cast<uint16_t>(field.value.offset),
+			IsInteger(base_type) ? field.default_value.i : 0,
+			IsFloat(base_type) ? field.default_value.f : 0,
+			field.deprecated, field.key, static_cast<uint16_t>(field.padding), doc);
+	}
+
+	Offset<reflection::Object> WriteObject(const StructDef &struct_def) {
+		auto &vec = struct_def.fields.vec;
+		auto fields = ByName(vec);
+		std::vector<Offset<reflection::Field>> field_offsets;
+		for (auto it = fields.begin(); it != fields.end(); ++it) {
+			auto id = std::find(vec.begin(), vec.end(), *it) - vec.begin();
+			field_offsets.push_back(WriteField(**it, static_cast<uint16_t>(id)));
+		}
+		auto name = mb_.CreateString(struct_def.name);
+		auto fields_vec = mb_.CreateVector(field_offsets);
+		auto doc = Doc(struct_def);
+		return reflection::CreateObject(mb_, name, fields_vec, struct_def.fixed,
+										static_cast<int32_t>(struct_def.minalign),
+										static_cast<int32_t>(struct_def.bytesize), doc);
+	}
+
+	Offset<reflection::Enum> WriteEnum(const EnumDef &enum_def) {
+		std::vector<Offset<reflection::EnumVal>> values;
+		for (auto it = enum_def.vals.vec.begin(); it != enum_def.vals.vec.end(); ++it) {
+			auto &ev = **it;
+			auto name = mb_.CreateString(ev.name);
+			auto doc = ev.doc_comment.empty() ? Offset<String>() : mb_.CreateString(ev.doc_comment);
+			values.push_back(reflection::CreateEnumVal(mb_, name, ev.value, Index(ev.struct_def), doc));
+		}
+		auto name = mb_.CreateString(enum_def.name);
+		auto values_vec = mb_.CreateVector(values);
+		auto type = WriteType(enum_def.underlying_type);
+		auto doc = Doc(enum_def);
+		return reflection::CreateEnum(mb_, name, values_vec, enum_def.is_union, type, doc);
+	}
+};
+
+}  // namespace schema
+
+void SerializeSchema(const Parser &parser, MegrezBuilder *mb) {
+	schema::SchemaWriter(parser, *mb).Write();
+}
+
+bool GenerateBinarySchema(const Parser &parser, const std::string &path,
+						  const std::string &file_name) {
+	MegrezBuilder mb;
+	SerializeSchema(parser, &mb);
+	std::string schema(reinterpret_cast<const char *>(mb.GetBufferPointer()), mb.GetSize());
+	return SaveFileIfChanged((path + file_name + ".mbs").c_str(), schema, true);
+}
+
+}  // namespace megrez
@@ -0,0 +1,416 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "megrez/basic.h"
+#include "megrez/info.h"
+#include "megrez/util.h"
+#include "megrez/verifier.h"
+#include "compiler/idl.h"
+
+namespace megrez {
+namespace text {
+
+// Turns a buffer into JSON by walking the StructDefs the parser built for
+// its schema. The text is written straight into the caller's string, which
+// can be handed in again to reuse its capacity: it is grown ahead of the
+// writes and trimmed at the end, instead of appending piece by piece. Reads
+// go through UnalignedReads, so buffers loaded at any address can be
+// printed. Without a verifier the buffer is trusted; with one, every
+// offset, vtable, length and field is checked against the buffer before
+// it is read, and the first one outside of it stops the printing.
+class JsonPrinter {
+ public:
+	JsonPrinter(std::string *text, int indent_step, Verifier *verifier = nullptr)
+		: text_(*text), cur_(nullptr), end_(nullptr), indent_step_(indent_step),
+			verifier_(verifier), valid_(true) {
+		text_.clear();
+	}
+	~JsonPrinter() { text_.resize(size()); }
+
+	bool valid() const { return valid_; }
+
+	void PrintInfo(const StructDef &struct_def, const uint8_t *info, int indent) {
+		if (verifier_ && !Check(verifier_->VerifyInfoStart(info))) return;
+		Put('{');
+		bool first = true;
+		uint8_t union_type = 0;
+		for (auto it = struct_def.fields.vec.begin();
+			 it != struct_def.fields.vec.end() && valid_; ++it) {
+			auto &field = **it;
+			auto field_offset = reinterpret_cast<const Info *>(info)->
+				GetOptionalFieldOffset<UnalignedReads>(static_cast<vofs_t>(field.value.offset));
+			if (!field_offset) continue;
+			auto p = info + field_offset;
+			auto &type = field.value.type;
+			if (!Inside(p, IsScalar(type.base_type) || IsStruct(type)
+				? InlineSize(type) : sizeof(uofs_t))) return;
+			// The type of a union is stored in the field declared just before it.
+			if (type.base_type == BASE_TYPE_UTYPE) union_type = *p;
+			FieldName(field.name, first, indent + indent_step_);
+			first = false;
+			if (type.base_type == BASE_TYPE_UNION) {
+				auto union_def = type.enum_def->ReverseLookup(union_type);
+				auto union_info = union_def ? Follow(p) : nullptr;
+				if (union_info) PrintInfo(*union_def, union_info, indent + indent_step_);
+				else if (!union_def) Put("null", 4);
+			} else {
+				PrintValue(type, p, indent + indent_step_);
+			}
+		}
+		if (!first) NewLine(indent);
+		Put('}');
+		if (verifier_) verifier_->EndInfo();
+	}
+
+	void NewLine(int indent) {
+		if (indent_step_ < 0) return;
+		Reserve(indent + 1);
+		*cur_++ = '\n';
+		memset(cur_, ' ', indent);
+		cur_ += indent;
+	}
+
+ private:
+	std::string &text_;
+	char *cur_, *end_;  // the unwritten part of text_
+	int indent_step_;
+	Verifier *verifier_;
+	bool valid_;
+
+	bool Check(bool ok) {
+		valid_ = valid_ && ok;
+		return ok;
+	}
+
+	bool Inside(const uint8_t *p, size_t len) { return !verifier_ || Check(verifier_->Verify(p, len)); }
+
+	// The length of a vector whose `elemsize` byte elements all have to be
+	// in the buffer, or 0 when they aren't.
+	uofs_t VectorLength(const uint8_t *vec, size_t elemsize) {
+		size_t end;
+		if (verifier_ && !Check(verifier_->VerifyVectorBytes(vec, elemsize, &end))) return 0;
+		return ReadScalar<uofs_t, UnalignedReads>(vec);
+	}
+
+	size_t size() const { return text_.size() - (end_ - cur_); }
+
+	// Make room for `n` more characters. Growing by doubling keeps the zero
+	// filling of resize() proportional to the output.
+	void Reserve(size_t n) {
+		if (static_cast<size_t>(end_ - cur_) >= n) return;
+		auto used = size();
+		text_.resize(std::max<size_t>((used + n) * 2, 256));
+		cur_ = &text_[0] + used;
+		end_ = &text_[0] + text_.size();
+	}
+
+	void Put(char c) {
+		Reserve(1);
+		*cur_++ = c;
+	}
+
+	void Put(const char *s, size_t n) {
+		Reserve(n);
+		memcpy(cur_, s, n);
+		cur_ += n;
+	}
+
+	// What the offset at `p` refers to, or nullptr if that isn't inside the
+	// buffer.
+	const uint8_t *Follow(const uint8_t *p) {
+		if (!verifier_) return p + ReadScalar<uofs_t, UnalignedReads>(p);
+		auto target = verifier_->VerifyOffset(p);
+		Check(target != nullptr);
+		return target;
+	}
+
+	void FieldName(const std::string &name, bool first, int indent) {
+		if (!first) Put(',');
+		NewLine(indent);
+		Reserve(name.size() + 4);
+		*cur_++ = '"';
+		memcpy(cur_, name.data(), name.size());
+		cur_ += name.size();
+		*cur_++ = '"';
+		*cur_++ = ':';
+		if (indent_step_ >= 0) *cur_++ = ' ';
+	}
+
+	// A value stored in place at `p`: scalars and structs, or the offset to
+	// anything else.
+	void PrintValue(const Type &type, const uint8_t *p, int indent) {
+		if (type.base_type == BASE_TYPE_BOOL) {
+			if (*p) Put("true", 4);
+			else Put("false", 5);
+			return;
+		}
+		if (!IsScalar(type.base_type) && !IsStruct(type)) {
+			p = Follow(p);
+			if (!p) return;
+		}
+		switch (type.base_type) {
+			case BASE_TYPE_STRING:
+				PrintString(p);
+				break;
+			case BASE_TYPE_VECTOR:
+				PrintVector(type.VectorType(), p, indent);
+				break;
+			case BASE_TYPE_MAP:
+				PrintMap(type, p, indent);
+				break;
+			case BASE_TYPE_STRUCT:
+				if (IsStruct(type)) PrintStruct(*type.struct_def, p, indent);
+				else PrintInfo(*type.struct_def, p, indent);
+				break;
+			case BASE_TYPE_UNION:
+				assert(0);  // printed by PrintInfo, which knows the type
+				break;
+			#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) \
+				case BASE_TYPE_ ## ENUM: \
+					PrintNumber(ReadScalar<CTYPE, UnalignedReads>(p)); \
+					break;
+				MEGREZ_GEN_TYPES_SCALAR(MEGREZ_TD)
+			#undef MEGREZ_TD
+			default:
+				assert(0);
+				break;
+		}
+	}
+
+	void PrintStruct(const StructDef &struct_def, const uint8_t *p, int indent) {
+		Put('{');
+		for (auto it = struct_def.fields.vec.begin(); it != struct_def.fields.vec.end(); ++it) {
+			FieldName((*it)->name, it == struct_def.fields.vec.begin(), indent + indent_step_);
+			PrintValue((*it)->value.type, p + (*it)->value.offset, indent + indent_step_);
+		}
+		NewLine(indent);
+		Put('}');
+	}
+
+	void PrintVector(const Type &type, const uint8_t *vec, int indent) {
+		auto elemsize = InlineSize(type);
+		auto len = VectorLength(vec, elemsize);
+		auto elem = vec + sizeof(uofs_t);
+		Put('[');
+		for (uofs_t i = 0; i < len && valid_; i++, elem += elemsize) {
+			if (i) Put(',');
+			NewLine(indent + indent_step_);
+			PrintValue(type, elem, indent + indent_step_);
+		}
+		if (len) NewLine(indent);
+		Put(']');
+	}
+
+	// A JSON object: string keys as they are, integer keys quoted.
+	void PrintMap(const Type &type, const uint8_t *map, int indent) {
+		auto key_type = type.KeyType();
+		auto value_type = type.VectorType();
+		auto keys = Follow(map + sizeof(uofs_t));
+		auto values = keys ? Follow(map + 2 * sizeof(uofs_t)) : nullptr;
+		if (!values) return;
+		auto len = VectorLength(keys, InlineSize(key_type));
+		if (!Check(VectorLength(values, InlineSize(value_type)) == len)) return;
+		auto key = keys + sizeof(uofs_t);
+		auto value = values + sizeof(uofs_t);
+		Put('{');
+		for (uofs_t i = 0; i < len && valid_; i++) {
+			if (i) Put(',');
+			NewLine(indent + indent_step_);
+			if (IsString(key_type.base_type)) {
+				auto str = Follow(key);
+				if (!str) return;
+				PrintString(str);
+			} else {
+				Put('"');
+				PrintValue(key_type, key, indent);
+				Put('"');
+			}
+			if (indent_step_ < 0) Put(':');
+			else Put(": ", 2);
+			PrintValue(value_type, value, indent + indent_step_);
+			key += InlineSize(key_type);
+			value += InlineSize(value_type);
+		}
+		if (len) NewLine(indent);
+		Put('}');
+	}
+
+	void PrintString(const uint8_t *str) {
+		auto len = VectorLength(str, 1);
+		auto s = reinterpret_cast<const char *>(str + sizeof(uofs_t));
+		Put('"');
+		// Copy runs of characters that need no escape in one go.
+		size_t run = 0;
+		for (uofs_t i = 0; i < len; i++) {
+			auto c = static_cast<unsigned char>(s[i]);
+			if (c >= ' ' && c != '"' && c != '\\') continue;
+			Put(s + run, i - run);
+			run = i + 1;
+			switch (c) {
+				case '\n': Put("\\n", 2); break;
+				case '\t': Put("\\t", 2); break;
+				case '\r': Put("\\r", 2); break;
+				case '\b': Put("\\b", 2); break;
+				case '\f': Put("\\f", 2); break;
+				case '"':  Put("\\\"", 2); break;
+				case '\\': Put("\\\\", 2); break;
+				default: {
+					static const char hex[] = "0123456789abcdef";
+					char u[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+					Put(u, sizeof(u));
+					break;
+				}
+			}
+		}
+		Put(s + run, len - run);
+		Put('"');
+	}
+
+	// The decimal digits of `v`, written two at a time backwards from `end`.
+	// Returns where they start.
+	static char *FormatDigits(uint64_t v, char *end) {
+		static const char pairs[] =
+			"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+			"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+			"8081828384858687888990919293949596979899";
+		auto p = end;
+		while (v >= 100) {
+			auto i = static_cast<size_t>(v % 100) * 2;
+			v /= 100;
+			*--p = pairs[i + 1];
+			*--p = pairs[i];
+		}
+		if (v >= 10) {
+			*--p = pairs[v * 2 + 1];
+			*--p = pairs[v * 2];
+		} else {
+			*--p = static_cast<char>('0' + v);
+		}
+		return p;
+	}
+
+	void PrintDigits(uint64_t v) {
+		char buf[20];
+		auto p = FormatDigits(v, buf + sizeof(buf));
+		Put(p, buf + sizeof(buf) - p);
+	}
+
+	template<typename T>
+	void PrintNumber(T v) {
+		if (v < 0) {
+			Put('-');
+			PrintDigits(0 - static_cast<uint64_t>(v));
+		} else {
+			PrintDigits(static_cast<uint64_t>(v));
+		}
+	}
+
+	void PrintNumber(float v) { PrintFloat(v, true); }
+	void PrintNumber(double v) { PrintFloat(v, false); }
+
+	// The fewest decimals that parse back to the same value. With the value
+	// scaled to an integer below 2^53, m / 10^k is exact in both operands, so
+	// its rounding is the one strtod does; anything else uses the shortest
+	// printf precision that reads back.
+	void PrintFloat(double v, bool single) {
+		if (!std::isfinite(v)) {
+			Put("null", 4);  // JSON has no inf or nan
+			return;
+		}
+		auto a = std::fabs(v);
+		double scale = 1;
+		for (int k = 0; k <= 17; k++, scale *= 10) {
+			auto m = std::round(a * scale);
+			if (m >= 9007199254740992.0) break;
+			auto back = m / scale;
+			if (single ? static_cast<float>(back) != static_cast<float>(a) : back != a) continue;
+			if (v < 0) Put('-');
+			// The digits of m, with a decimal point k digits from the end.
+			char buf[20];
+			auto digits = FormatDigits(static_cast<uint64_t>(m), buf + sizeof(buf));
+			auto n = static_cast<int>(buf + sizeof(buf) - digits);
+			Reserve(n + k + 3);
+			if (n <= k) {
+				*cur_++ = '0';
+				*cur_++ = '.';
+				memset(cur_, '0', k - n);
+				cur_ += k - n;
+				memcpy(cur_, digits, n);
+				cur_ += n;
+			} else {
+				memcpy(cur_, digits, n - k);
+				cur_ += n - k;
+				*cur_++ = '.';
+				if (k) {
+					memcpy(cur_, digits + n - k, k);
+					cur_ += k;
+				} else {
+					*cur_++ = '0';
+				}
+			}
+			return;
+		}
+		char buf[32];
+		int len = 0;
+		for (int precision = single ? 6 : 15; precision <= (single ? 9 : 17); precision++) {
+			len = snprintf(buf, sizeof(buf), "%.*g", precision, v);
+			auto back = strtod(buf, nullptr);
+			if (single ? static_cast<float>(back) == static_cast<float>(v) : back == v) break;
+		}
+		Put(buf, len);
+	}
+};
+
+}  // namespace text
+
+void GenerateText(const Parser &parser, const void *megrez_buffer, int indent_step,
+				  std::string *text) {
+	assert(parser.main_struct_def);
+	text::JsonPrinter printer(text, indent_step);
+	auto buf = reinterpret_cast<const uint8_t *>(megrez_buffer);
+	printer.PrintInfo(*parser.main_struct_def,
+					  buf + ReadScalar<uofs_t, UnalignedReads>(buf), 0);
+	printer.NewLine(0);
+}
+
+bool GenerateText(const Parser &parser, const void *megrez_buffer, size_t size,
+				  int indent_step, std::string *text) {
+	assert(parser.main_struct_def);
+	auto buf = reinterpret_cast<const uint8_t *>(megrez_buffer);
+	Verifier verifier(buf, size, 64, 1000000, false);
+	text::JsonPrinter printer(text, indent_step, &verifier);
+	auto root = verifier.VerifyOffset(buf);
+	if (!root) return false;
+	printer.PrintInfo(*parser.main_struct_def, root, 0);
+	printer.NewLine(0);
+	return printer.valid();
+}
+
+bool GenerateTextFile(const Parser &parser, const std::string &path, const std::string &file_name) {
+	if (!parser.builder_.GetSize() || !parser.main_struct_def) return true;
+	std::string text;
+	if (!GenerateText(parser, parser.builder_.GetBufferPointer(), parser.builder_.GetSize(), 2,
+					  &text))
+		return false;
+	return SaveFileIfChanged((path + file_name + ".json").c_str(), text, false);
+}
+
+}  // namespace megrez
@@ -19,11 +19,16 @@ limitations under the License.
 
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 #include <vector>
 #include <string.h>
 #include <assert.h>
 
+#include "megrez/allocator.h"
 #include "megrez/basic.h"
+#include "megrez/batch.h"
 #include "megrez/builder.h"
 #include "megrez/info.h"
 #include "megrez/string.h"
@@ -51,7 +56,8 @@ namespace megrez {
 	TD(STRING, "string", Offset<void>) \
 	TD(VECTOR, "",       Offset<void>) \
 	TD(STRUCT, "",       Offset<void>) \
-	TD(UNION,  "",       Offset<void>)
+	TD(UNION,  "",       Offset<void>) \
+	TD(MAP,    "map",    Offset<void>)
 #define MEGREZ_GEN_TYPES(TD) \
 		MEGREZ_GEN_TYPES_SCALAR(TD) \
 		MEGREZ_GEN_TYPES_POINTER(TD)
@@ -82,14 +88,17 @@ struct Type {
 	explicit Type(BaseType _base_type = BASE_TYPE_NONE, StructDef *_sd = nullptr)
 		: base_type(_base_type),
 		  element(BASE_TYPE_NONE),
+		  key(BASE_TYPE_NONE),
 		  struct_def(_sd),
 		  enum_def(nullptr) {}
 
 	Type VectorType() const { return Type(element, struct_def); }
+	Type KeyType() const { return Type(key); }
 	BaseType base_type;
-	BaseType element;       // only set if t == BASE_TYPE_VECTOR
+	BaseType element;       // only set if t == BASE_TYPE_VECTOR, or the map value
+	BaseType key;           // only set if t == BASE_TYPE_MAP
 	StructDef *struct_def;  // only set if t or element == BASE_TYPE_STRUCT
-	EnumDef *enum_def;      // only set if t == BASE_TYPE_UNION / BASE_TYPE_UTYPE
+	EnumDef *enum_def;      // set for unions, union types and enums, or their vectors
 };
 
 struct Value {
@@ -100,20 +109,41 @@ struct Value {
 	int offset;
 };
 
+// A JSON value on its way into a buffer, held in the form it is written in:
+// scalars converted once from their token, strings, vectors, maps and infos
+// as the offset they were serialized at, and structs as their position in
+// the parser's struct stack. The type comes from the field or element.
+union DataValue {
+	DataValue() : i(0) {}
+
+	int64_t i;  // integers, bools and enums, unsigned ones stored as their bits
+	double f;
+	uofs_t o;
+};
+
+// Definitions by name and in declaration order. The definitions live in
+// the arena of the parser that made them: a SymbolInfo destroys them, and
+// the arena frees their memory afterwards.
 template<typename T> 
 class SymbolInfo {
  private:
-	std::map<std::string, T *> dict;
+	std::unordered_map<std::string, T *> dict;
+	std::set<const T *> shared;
  public:
 	std::vector<T *> vec;
  public:
-	~SymbolInfo() { for (auto it = vec.begin(); it != vec.end(); ++it) { delete *it; } }
+	~SymbolInfo() {
+		for (auto it = vec.begin(); it != vec.end(); ++it)
+			if (!shared.count(*it)) (*it)->~T();
+	}
 	bool Add(const std::string &name, T *e) {
 		vec.emplace_back(e);
-		auto it = dict.find(name);
-		if (it != dict.end()) return true;
-		dict[name] = e;
-		return false;
+		return !dict.emplace(name, e).second;
+	}
+	// Lists `e` too, without destroying it: it belongs to another parser.
+	bool AddShared(const std::string &name, T *e) {
+		shared.insert(e);
+		return Add(name, e);
 	}
 
 	T *Lookup(const std::string &name) const {
@@ -128,12 +158,15 @@ struct Definition {
 	std::string doc_comment;
 	SymbolInfo<Value> attributes;
 	bool generated;  // did we already output code for this definition?
+	std::vector<std::string> name_space;  // where it was declared
 };
 
 struct FieldDef : public Definition {
-	FieldDef() : deprecated(false), padding(0) {}
+	FieldDef() : deprecated(false), key(false), padding(0) {}
 	Value value;
+	DataValue default_value;  // value.constant of a scalar, converted once
 	bool deprecated;
+	bool key;  // vectors of this info can be sorted and searched by this field
 	size_t padding;  // bytes to always pad after this field
 };
 
@@ -142,6 +175,7 @@ struct StructDef : public Definition {
 	: fixed(false),
 	  predecl(true),
 	  sortbysize(true),
+	  has_key(false),
 	  minalign(1),
 	  bytesize(0) {}
 
@@ -155,6 +189,7 @@ struct StructDef : public Definition {
 	bool fixed;       // If it's struct, not a info.
 	bool predecl;     // If it's used before it was defined.
 	bool sortbysize;  // Whether fields come in the declaration or size order.
+	bool has_key;     // One of the fields has the key attribute.
 	size_t minalign;  // What the whole object needs to be aligned to.
 	size_t bytesize;  // Size if fixed.
 };
@@ -194,53 +229,135 @@ struct EnumDef : public Definition {
 	Type underlying_type;
 };
 
+// Options for the code generators, set from the MegrezC command line.
+struct IDLOptions {
+	IDLOptions()
+		: offset_bits(32), generate_mutable(false), generate_object_api(false),
+			unaligned_reads(false) {}
+	int offset_bits;  // MEGREZ_OFFSET_BITS the generated code is built with
+	bool generate_mutable;  // mutate_ accessors and GetMutable roots
+	bool generate_object_api;  // <Type>T objects with UnPack and Pack
+	bool unaligned_reads;  // accessors read with megrez::UnalignedReads
+	std::vector<std::string> include_paths;  // searched after the including file's directory
+};
+
+class IncludeCache;
+
 class Parser {
  public:
-	Parser() :
+	// With an `include_cache`, files it has parsed already aren't parsed
+	// again: their definitions are used as they are, so the cache must
+	// outlive the parser.
+	explicit Parser(IncludeCache *include_cache = nullptr) :
 		main_struct_def(nullptr),
 		source_(nullptr),
 		cursor_(nullptr),
-		line_(1) {}
-	bool Parse(const char *_source);
+		line_(1),
+		include_cache_(include_cache) {}
+	// `source_filename` locates the files the schema includes, each of
+	// which is parsed only once. Their definitions are marked generated:
+	// code for them comes from compiling them on their own.
+	bool Parse(const char *_source, const char *source_filename = nullptr);
 	bool SetMainType(const char *name);
+	// Data only, once a schema with a main type has been parsed: one JSON
+	// object finished into builder_, or a stream of them, e.g. one per line,
+	// each appended to `batch` as a size-prefixed message. builder_ and its
+	// memory are reused for every object. On an error the messages before
+	// the bad object are left in the batch.
+	bool ParseJson(const char *json);
+	bool ParseJsonLines(const char *json, BatchBuilder *batch);
 
  private:
 	void Next();
+	void ParseUnicodeEscape();
 	bool IsNext(int t);
 	void Expect(int t);
 	void ParseType(Type &type);
 	FieldDef &AddField(StructDef &struct_def, const std::string &name, const Type &type);
 	void ParseField(StructDef &struct_def);
-	void ParseAnyValue(Value &val, FieldDef *field);
+	DataValue ParseAnyValue(const Type &type, FieldDef *field);
+	DataValue ParseScalar(BaseType type);
 	uofs_t ParseInfo(const StructDef &struct_def);
-	void SerializeStruct(const StructDef &struct_def, const Value &val);
-	void AddVector(bool sortbysize, int count);
+	void SerializeStruct(const StructDef &struct_def, DataValue val);
 	uofs_t ParseVector(const Type &type);
+	uofs_t SerializeVector(const Type &type, int count);
+	uofs_t ParseMap(const Type &type);
+	void SortByKey(const StructDef &struct_def, int count);
 	void ParseMetaData(Definition &def);
 	bool TryTypedValue(int dtoken, bool check, Value &e, BaseType req);
 	void ParseSingleValue(Value &e);
 	StructDef *LookupCreateStruct(const std::string &name);
 	void ParseEnum(bool is_union);
 	void ParseDecl();
+	void ParseFile(const char *source, const std::string &filename,
+				   std::vector<std::string> *includes);
+	void ParseInclude(std::vector<std::string> *includes);
+	bool ShareDefinitions(const Parser &included);
+	bool ParseData(const char *json, BatchBuilder *batch);
+	template<typename T, typename... Args> T *NewDef(Args &&...args);
+
+	// Before the definitions it holds, so that it is destroyed after them.
+	ArenaAllocator arena_;
 
  public:
 	SymbolInfo<StructDef> structs_;
 	SymbolInfo<EnumDef> enums_;
 	std::vector<std::string> name_space_;  // As set in the schema.
+	std::vector<std::string> includes_;  // As written in the schema, not those of included files.
 	std::string error_;         // User readable error_ if Parse() == false
 	MegrezBuilder builder_;  // any data contained in the file
 	StructDef *main_struct_def;
+	IDLOptions opts;
 
  private:
 	const char *source_, *cursor_;
 	int line_;  // the current line being parsed
+	std::string file_being_parsed_;  // "" for a source without a file name
+	std::set<std::string> included_files_;  // by AbsolutePath, once parsing started
+	std::set<std::string> parsed_files_;    // those of them parsed by this parser
+	IncludeCache *include_cache_;
 	int token_;
 	std::string attribute_, doc_comment_;
-	std::vector<std::pair<Value, FieldDef *>> field_stack_;
+	std::vector<std::pair<DataValue, FieldDef *>> field_stack_;
 	std::vector<uint8_t> struct_stack_;
 };
 
-extern void GenerateText(const Parser &parser, const void *Megrez, int indent_step, std::string *text);
+// Included files parsed once for all the parsers given this cache, such
+// as those compiling several schemas at once on different threads. Each
+// file is parsed, by one thread at a time, on first use, and its parser
+// kept here; its definitions don't change after that.
+class IncludeCache {
+ public:
+	// Sets `*parser` to the parser of the file at `path`, by AbsolutePath,
+	// parsed from `contents` with `opts` the first time. Returns false if the
+	// file has errors, for the including parser to parse it itself and report
+	// them. `*parser` is left nullptr for a file included while it is being
+	// parsed, which is skipped as it is within a single parser.
+	bool Get(const std::string &path, const std::string &filename,
+			 const std::string &contents, const IDLOptions &opts, const Parser **parser);
+
+ private:
+	std::recursive_mutex mutex_;
+	std::map<std::string, std::unique_ptr<Parser>> parsers_;  // nullptr if it has errors
+	std::set<std::string> parsing_;
+};
+
+// JSON for a buffer whose main type is parser.main_struct_def, indented by
+// indent_step spaces per level, or on one line when indent_step is negative.
+extern void GenerateText(const Parser &parser, const void *megrez_buffer, int indent_step,
+						 std::string *text);
+// The same for a buffer of `size` bytes from elsewhere, checked while it is
+// printed. Returns false, with the text cut short, if it isn't valid.
+extern bool GenerateText(const Parser &parser, const void *megrez_buffer, size_t size,
+						 int indent_step, std::string *text);
+extern bool GenerateTextFile(const Parser &parser, const std::string &path,
+							 const std::string &file_name);
+
+// The schema of a parser as a megrez::reflection::Schema buffer, for
+// megrez/reflection.h. GenerateBinarySchema writes it to a .mbs file.
+extern void SerializeSchema(const Parser &parser, MegrezBuilder *mb);
+extern bool GenerateBinarySchema(const Parser &parser, const std::string &path,
+								 const std::string &file_name);
 
 extern std::string GenerateCPP(const Parser &parser);
 extern bool GenerateCPP(const Parser &parser, const std::string &path, const std::string &file_name);
@@ -15,6 +15,8 @@ limitations under the License.
 ========================================================================*/
 // The implementation of parser in `idl.h`
 
+#include <unordered_set>
+
 #include "megrez/basic.h"
 #include "megrez/builder.h"
 #include "megrez/info.h"
@@ -43,28 +45,44 @@ static void Error(const std::string &msg) { throw msg; }
 
 // Ensure that integer values we parse fit inside the declared integer type.
 static void CheckBitsFit(int64_t val, size_t bits) {
+	if (bits >= 64) return;
 	auto mask = (1ll << bits) - 1;  // Bits we allow to be used.
-	if (bits < 64 &&
-		(val & ~mask) != 0 &&  // Positive or unsigned.
+	if ((val & ~mask) != 0 &&  // Positive or unsigned.
 		(val |  mask) != -1)   // Negative.
 		Error("Constant does not fit in a " + NumToString(bits) + "-bit field");
 }
 
-// atot: templated version of atoi/atof: convert a string to an instance of T.
-template<typename T> 
-inline T atot(const char *s) {
-	auto val = StringToInt(s);
-	CheckBitsFit(val, sizeof(T) * 8);
-	return (T)val;
+// The DataValue of a scalar field of `type` set to the integer `val`.
+static DataValue ScalarFromInt(BaseType type, int64_t val) {
+	DataValue v;
+	if (IsFloat(type)) {
+		v.f = static_cast<double>(val);
+	} else if (type == BASE_TYPE_BOOL) {
+		v.i = val != 0;
+	} else {
+		CheckBitsFit(val, SizeOf(type) * 8);
+		v.i = val;
+	}
+	return v;
 }
+
+// The DataValue of a scalar field of `type` set to a number token.
+static DataValue ScalarFromText(BaseType type, const char *s) {
+	if (!IsFloat(type)) return ScalarFromInt(type, StringToInt(s));
+	DataValue v;
+	v.f = strtod(s, nullptr);
+	return v;
+}
+
+// ValueAs: a DataValue as the C++ type of the field it is written to.
+template<typename T> 
+inline T ValueAs(DataValue v) { return static_cast<T>(v.i); }
 template<> 
-inline bool atot<bool>(const char *s) { return 0 != atoi(s); }
-template<> 
-inline float atot<float>(const char *s) { return static_cast<float>(strtod(s, nullptr)); }
+inline float ValueAs<float>(DataValue v) { return static_cast<float>(v.f); }
 template<> 
-inline double atot<double>(const char *s) { return strtod(s, nullptr); }
+inline double ValueAs<double>(DataValue v) { return v.f; }
 template<> 
-inline Offset<void> atot<Offset<void>>(const char *s) { return Offset<void>(atoi(s)); }
+inline Offset<void> ValueAs<Offset<void>>(DataValue v) { return Offset<void>(v.o); }
 
 #define MEGREZ_GEN_TOKENS(TD) \
 	TD(Eof, 256, "end of file") \
@@ -77,9 +95,10 @@ inline Offset<void> atot<Offset<void>>(const char *s) { return Offset<void>(atoi
 	TD(Enum, 263, "enum") \
 	TD(Union, 264, "union") \
 	TD(NameSpace, 265, "namespace") \
-	TD(MainType, 266, "Main")
+	TD(MainType, 266, "Main") \
+	TD(Include, 267, "include")
 enum {
-	#define MEGREZ_TOKEN(NAME, VALUE, STRING) kToken ## NAME,
+	#define MEGREZ_TOKEN(NAME, VALUE, STRING) kToken ## NAME = VALUE,
 		MEGREZ_GEN_TOKENS(MEGREZ_TOKEN)
 	#undef MEGREZ_TOKEN
 	#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) kToken ## ENUM,
@@ -87,6 +106,63 @@ enum {
 	#undef MEGREZ_TD
 };
 
+// Type names and keywords, found with a perfect hash of their first and
+// last characters and their length: each has a slot of its own, so one
+// comparison tells a keyword from an identifier. A new keyword that would
+// share a slot trips the assert; change the multipliers then.
+class Keywords {
+ public:
+	struct Keyword {
+		const char *name;
+		size_t len;
+		int token;
+	};
+
+	static const Keywords &Get() {
+		static const Keywords keywords;
+		return keywords;
+	}
+
+	const Keyword *Find(const char *s, size_t len) const {
+		auto &keyword = slots_[Slot(s, len)];
+		return keyword.len == len && !memcmp(keyword.name, s, len) ? &keyword : nullptr;
+	}
+
+ private:
+	static const size_t kSlots = 64;
+	Keyword slots_[kSlots];
+
+	static size_t Slot(const char *s, size_t len) {
+		return (static_cast<unsigned char>(s[0]) * 2 +
+				static_cast<unsigned char>(s[len - 1]) * 42 + len) & (kSlots - 1);
+	}
+
+	Keywords() : slots_() {
+		#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) Add(IDLTYPE, kToken ## ENUM);
+			MEGREZ_GEN_TYPES(MEGREZ_TD)
+		#undef MEGREZ_TD
+		Add("true", kTokenIntegerConstant);
+		Add("false", kTokenIntegerConstant);
+		Add("info", kTokenInfo);
+		Add("struct", kTokenStruct);
+		Add("enum", kTokenEnum);
+		Add("union", kTokenUnion);
+		Add("namespace", kTokenNameSpace);
+		Add("Main", kTokenMainType);
+		Add("include", kTokenInclude);
+	}
+
+	void Add(const char *name, int token) {
+		auto len = strlen(name);
+		if (!len) return;  // types without a name in schemas
+		auto &keyword = slots_[Slot(name, len)];
+		assert(!keyword.name);
+		keyword.name = name;
+		keyword.len = len;
+		keyword.token = token;
+	}
+};
+
 static std::string TokenToString(int t) {
 	static const char *tokens[] = {
 		#define MEGREZ_TOKEN(NAME, VALUE, STRING) STRING,
@@ -115,27 +191,33 @@ void Parser::Next() {
 			case '\n': line_++; seen_newline = true; break;
 			case '{': case '}': case '(': case ')': case '[': case ']': return;
 			case ',': case ':': case ';': case '=': return;
+			case '<': case '>': return;
 			case '.':
 				if(!isdigit(*cursor_)) return;
 				Error("Floating point constant can\'t start with \".\"");
 				break;
 			case '\"':
-				attribute_ = "";
-				while (*cursor_ != '\"') {
-					if (*cursor_ < ' ' && *cursor_ >= 0)
-						Error("Illegal character in string constant");
-					if (*cursor_ == '\\') {
+				attribute_.clear();
+				for (;;) {
+					// Append runs of plain characters in one go.
+					const char *start = cursor_;
+					while (*cursor_ != '\"' && *cursor_ != '\\' && (*cursor_ >= ' ' || *cursor_ < 0))
 						cursor_++;
-						switch (*cursor_) {
-							case 'n':  attribute_ += '\n'; cursor_++; break;
-							case 't':  attribute_ += '\t'; cursor_++; break;
-							case 'r':  attribute_ += '\r'; cursor_++; break;
-							case '\"': attribute_ += '\"'; cursor_++; break;
-							case '\\': attribute_ += '\\'; cursor_++; break;
-							default: Error("Unknown escape code in string constant"); break;
-						}
-					} else {
-						attribute_ += *cursor_++;
+					attribute_.append(start, cursor_);
+					if (*cursor_ == '\"') break;
+					if (*cursor_ != '\\') Error("Illegal character in string constant");
+					cursor_++;
+					switch (*cursor_) {
+						case 'n':  attribute_ += '\n'; cursor_++; break;
+						case 't':  attribute_ += '\t'; cursor_++; break;
+						case 'r':  attribute_ += '\r'; cursor_++; break;
+						case 'b':  attribute_ += '\b'; cursor_++; break;
+						case 'f':  attribute_ += '\f'; cursor_++; break;
+						case '\"': attribute_ += '\"'; cursor_++; break;
+						case '\\': attribute_ += '\\'; cursor_++; break;
+						case '/':  attribute_ += '/'; cursor_++; break;
+						case 'u':  cursor_++; ParseUnicodeEscape(); break;
+						default: Error("Unknown escape code in string constant"); break;
 					}
 				}
 				cursor_++;
@@ -163,40 +245,33 @@ void Parser::Next() {
 						cursor_++;
 					attribute_.clear();
 					attribute_.append(start, cursor_);
-					// First, see if it is a type keyword from the info of types:
-					#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) \
-						if (attribute_ == IDLTYPE) { \
-							token_ = kToken ## ENUM; \
-							return; \
-						}
-						MEGREZ_GEN_TYPES(MEGREZ_TD)
-					#undef MEGREZ_TD
-					// If it's a boolean constant keyword, turn those into integers,
-					// which simplifies our logic downstream.
-					if (attribute_ == "true" || attribute_ == "false") {
-						attribute_ = NumToString(attribute_ == "true");
-						token_ = kTokenIntegerConstant;
+					auto keyword = Keywords::Get().Find(start, cursor_ - start);
+					if (!keyword) {
+						token_ = kTokenIdentifier;
 						return;
 					}
-					// Check for declaration keywords:
-					if (attribute_ == "info")     { token_ = kTokenInfo;     return; }
-					if (attribute_ == "struct")    { token_ = kTokenStruct;    return; }
-					if (attribute_ == "enum")      { token_ = kTokenEnum;      return; }
-					if (attribute_ == "union")     { token_ = kTokenUnion;     return; }
-					if (attribute_ == "namespace") { token_ = kTokenNameSpace; return; }
-					if (attribute_ == "Main") { token_ = kTokenMainType;  return; }
-					// If not, it is a user-defined identifier:
-					token_ = kTokenIdentifier;
+					token_ = keyword->token;
+					// Boolean constants are turned into integers, which simplifies
+					// our logic downstream.
+					if (token_ == kTokenIntegerConstant)
+						attribute_ = keyword->name[0] == 't' ? "1" : "0";
 					return;
 				} else if (isdigit(static_cast<unsigned char>(c)) || c == '-') {
 					const char *start = cursor_ - 1;
 					while (isdigit(static_cast<unsigned char>(*cursor_))) cursor_++;
+					token_ = kTokenIntegerConstant;
 					if (*cursor_ == '.') {
 						cursor_++;
 						while (isdigit(static_cast<unsigned char>(*cursor_))) cursor_++;
 						token_ = kTokenFloatConstant;
-					} else {
-						token_ = kTokenIntegerConstant;
+					}
+					if (*cursor_ == 'e' || *cursor_ == 'E') {
+						cursor_++;
+						if (*cursor_ == '+' || *cursor_ == '-') cursor_++;
+						if (!isdigit(static_cast<unsigned char>(*cursor_)))
+							Error("Missing digits in exponent");
+						while (isdigit(static_cast<unsigned char>(*cursor_))) cursor_++;
+						token_ = kTokenFloatConstant;
 					}
 					attribute_.clear();
 					attribute_.append(start, cursor_);
@@ -211,6 +286,47 @@ void Parser::Next() {
 	}
 }
 
+// The four hex digits after \u, appended as UTF-8. A high surrogate has to
+// be followed by the \u escape of its low surrogate.
+void Parser::ParseUnicodeEscape() {
+	auto hex = [this]() {
+		unsigned v = 0;
+		for (int i = 0; i < 4; i++, cursor_++) {
+			auto c = *cursor_;
+			if (!isxdigit(static_cast<unsigned char>(c)))
+				Error("Expected four hex digits after \\u");
+			v = v * 16 + (isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c | 0x20) - 'a' + 10);
+		}
+		return v;
+	};
+	auto ucc = hex();
+	if (ucc >= 0xD800 && ucc < 0xDC00) {
+		if (cursor_[0] != '\\' || cursor_[1] != 'u')
+			Error("Missing low surrogate after a high surrogate");
+		cursor_ += 2;
+		auto low = hex();
+		if (low < 0xDC00 || low >= 0xE000) Error("Invalid low surrogate");
+		ucc = 0x10000 + ((ucc - 0xD800) << 10) + (low - 0xDC00);
+	} else if (ucc >= 0xDC00 && ucc < 0xE000) {
+		Error("Unpaired low surrogate");
+	}
+	if (ucc < 0x80) {
+		attribute_ += static_cast<char>(ucc);
+	} else if (ucc < 0x800) {
+		attribute_ += static_cast<char>(0xC0 | (ucc >> 6));
+		attribute_ += static_cast<char>(0x80 | (ucc & 0x3F));
+	} else if (ucc < 0x10000) {
+		attribute_ += static_cast<char>(0xE0 | (ucc >> 12));
+		attribute_ += static_cast<char>(0x80 | ((ucc >> 6) & 0x3F));
+		attribute_ += static_cast<char>(0x80 | (ucc & 0x3F));
+	} else {
+		attribute_ += static_cast<char>(0xF0 | (ucc >> 18));
+		attribute_ += static_cast<char>(0x80 | ((ucc >> 12) & 0x3F));
+		attribute_ += static_cast<char>(0x80 | ((ucc >> 6) & 0x3F));
+		attribute_ += static_cast<char>(0x80 | (ucc & 0x3F));
+	}
+}
+
 bool Parser::IsNext(int t) {
 	bool isnext = t == token_;
 	if (isnext) Next();
@@ -232,6 +348,7 @@ void Parser::ParseType(Type &type) {
 			auto enum_def = enums_.Lookup(attribute_);
 			if (enum_def) {
 				type = enum_def->underlying_type;
+				type.enum_def = enum_def;
 				if (enum_def->is_union) type.base_type = BASE_TYPE_UNION;
 			} else {
 				type.base_type = BASE_TYPE_STRUCT;
@@ -251,10 +368,32 @@ void Parser::ParseType(Type &type) {
 				// union element.
 				Error("Vector of union types not supported (wrap in info first).");
 			}
+			if (subtype.base_type == BASE_TYPE_MAP)
+				Error("Vector of map types not supported (wrap in info first).");
 			type = Type(BASE_TYPE_VECTOR, subtype.struct_def);
 			type.element = subtype.base_type;
+			type.enum_def = subtype.enum_def;
 			Expect(']');
 			return;
+		} else if (token_ == kTokenMAP) {
+			Next();
+			Expect('<');
+			Type key_type, value_type;
+			ParseType(key_type);
+			if (!IsInteger(key_type.base_type) && !IsString(key_type.base_type))
+				Error("Map keys must be integers or strings.");
+			Expect(',');
+			ParseType(value_type);
+			if (value_type.base_type == BASE_TYPE_VECTOR ||
+				value_type.base_type == BASE_TYPE_UNION ||
+				value_type.base_type == BASE_TYPE_MAP)
+				Error("Map values can't be vectors, unions or maps (wrap in info first).");
+			type = Type(BASE_TYPE_MAP, value_type.struct_def);
+			type.element = value_type.base_type;
+			type.enum_def = value_type.enum_def;
+			type.key = key_type.base_type;
+			Expect('>');
+			return;
 		} else {
 			Error("Illegal type syntax");
 		}
@@ -263,7 +402,7 @@ void Parser::ParseType(Type &type) {
 }
 
 FieldDef &Parser::AddField(StructDef &struct_def, const std::string &name, const Type &type) {
-	auto &field = *new FieldDef();
+	auto &field = *NewDef<FieldDef>();
 	field.value.offset =
 		FieldIndexToOffset(static_cast<vofs_t>(struct_def.fields.vec.size()));
 	field.name = name;
@@ -305,73 +444,127 @@ void Parser::ParseField(StructDef &struct_def) {
 		Next();
 		ParseSingleValue(field.value);
 	}
+	if (IsScalar(type.base_type))
+		field.default_value = ScalarFromText(type.base_type, field.value.constant.c_str());
 
 	field.doc_comment = dc;
 	ParseMetaData(field);
 	field.deprecated = field.attributes.Lookup("deprecated") != nullptr;
 	if (field.deprecated && struct_def.fixed)
 		Error("Cannot deprecate fields in a struct");
+	field.key = field.attributes.Lookup("key") != nullptr;
+	if (field.key) {
+		if (struct_def.fixed)
+			Error("Only fields of an info can be a key: " + name);
+		if (struct_def.has_key)
+			Error("Only one field may be a key: " + name);
+		if (!IsScalar(type.base_type) && !IsString(type.base_type))
+			Error("A key must be a scalar or a string: " + name);
+		struct_def.has_key = true;
+	}
 	Expect(';');
 }
 
-void Parser::ParseAnyValue(Value &val, FieldDef *field) {
-	switch (val.type.base_type) {
+DataValue Parser::ParseAnyValue(const Type &type, FieldDef *field) {
+	DataValue val;
+	switch (type.base_type) {
 		case BASE_TYPE_UNION: {
 			assert(field);
-			if (!field_stack_.size() ||
+			if (!field_stack_.size() || !field_stack_.back().second ||
 				 field_stack_.back().second->value.type.base_type != BASE_TYPE_UTYPE)
 				Error("Missing type field before this union value: " + field->name);
-			auto enum_idx = atot<unsigned char>(
-																		field_stack_.back().first.constant.c_str());
-			auto struct_def = val.type.enum_def->ReverseLookup(enum_idx);
+			auto enum_idx = static_cast<int>(field_stack_.back().first.i);
+			auto struct_def = type.enum_def->ReverseLookup(enum_idx);
 			if (!struct_def) Error("Illegal type id for: " + field->name);
-			val.constant = NumToString(ParseInfo(*struct_def));
+			val.o = ParseInfo(*struct_def);
 			break;
 		}
 		case BASE_TYPE_STRUCT:
-			val.constant = NumToString(ParseInfo(*val.type.struct_def));
+			val.o = ParseInfo(*type.struct_def);
 			break;
-		case BASE_TYPE_STRING: {
-			auto s = attribute_;
-			Expect(kTokenStringConstant);
-			val.constant = NumToString(builder_.CreateString(s).o);
+		case BASE_TYPE_STRING:
+			if (token_ != kTokenStringConstant) Expect(kTokenStringConstant);
+			val.o = builder_.CreateString(attribute_).o;
+			Next();
 			break;
-		}
-		case BASE_TYPE_VECTOR: {
+		case BASE_TYPE_VECTOR:
 			Expect('[');
-			val.constant = NumToString(ParseVector(val.type.VectorType()));
+			val.o = ParseVector(type.VectorType());
+			break;
+		case BASE_TYPE_MAP:
+			val.o = ParseMap(type);
 			break;
-		}
 		default:
-			ParseSingleValue(val);
+			val = ParseScalar(type.base_type);
 			break;
 	}
+	return val;
+}
+
+// A scalar JSON value, converted straight from its token to the field type.
+DataValue Parser::ParseScalar(BaseType type) {
+	DataValue val;
+	BaseType found = BASE_TYPE_INT;
+	bool match = false;
+	switch (token_) {
+		case kTokenIntegerConstant:
+			match = IsScalar(type);
+			if (match) val = ScalarFromText(type, attribute_.c_str());
+			break;
+		case kTokenFloatConstant:
+			found = BASE_TYPE_FLOAT;
+			match = IsFloat(type);
+			if (match) val = ScalarFromText(type, attribute_.c_str());
+			break;
+		case kTokenStringConstant:
+		case kTokenIdentifier: {
+			// An enum value by name, quoted as strict JSON writers do or not.
+			const EnumVal *ev = nullptr;
+			for (auto it = enums_.vec.begin(); it != enums_.vec.end() && !ev; ++it)
+				ev = (*it)->vals.Lookup(attribute_);
+			if (!ev) {
+				if (token_ == kTokenIdentifier) Error("Not valid enum value: " + attribute_);
+				found = BASE_TYPE_STRING;
+				break;
+			}
+			match = IsInteger(type);
+			if (match) val = ScalarFromInt(type, ev->value);
+			break;
+		}
+		default:
+			Error("Cannot parse value starting with: " + TokenToString(token_));
+	}
+	if (!match)
+		Error(std::string("Type mismatch: expecting: ") + kTypeNames[type] +
+			  ", found: " + kTypeNames[found]);
+	Next();
+	return val;
 }
 
-void Parser::SerializeStruct(const StructDef &struct_def, const Value &val) {
-	auto off = atot<uofs_t>(val.constant.c_str());
-	assert(struct_stack_.size() - off == struct_def.bytesize);
-	builder_.Align(struct_def.minalign);
-	builder_.PushBytes(&struct_stack_[off], struct_def.bytesize);
+// Move a struct from the struct stack into the buffer.
+void Parser::SerializeStruct(const StructDef &struct_def, DataValue val) {
+	assert(struct_stack_.size() - val.o == struct_def.bytesize);
+	builder_.StartStruct(struct_def.minalign);
+	builder_.PushBytes(&struct_stack_[val.o], struct_def.bytesize);
 	struct_stack_.resize(struct_stack_.size() - struct_def.bytesize);
-	builder_.AddStructOffset(val.offset, builder_.GetSize());
 }
 
 uofs_t Parser::ParseInfo(const StructDef &struct_def) {
 	Expect('{');
 	size_t fieldn = 0;
-	for (;;) {
-		std::string name = attribute_;
-		if (!IsNext(kTokenStringConstant)) Expect(kTokenIdentifier);
-		auto field = struct_def.fields.Lookup(name);
-		if (!field) Error("Unknown field: " + name);
+	if (!IsNext('}')) for (;;) {
+		if (token_ != kTokenStringConstant && token_ != kTokenIdentifier) Expect(kTokenIdentifier);
+		auto field = struct_def.fields.Lookup(attribute_);
+		if (!field) Error("Unknown field: " + attribute_);
 		if (struct_def.fixed && (fieldn >= struct_def.fields.vec.size()
 			|| struct_def.fields.vec[fieldn] != field)) {
-			 Error("Struct field appearing out of order: " + name);
+			 Error("Struct field appearing out of order: " + field->name);
 		}
+		for (auto it = field_stack_.rbegin(); it != field_stack_.rbegin() + fieldn; ++it)
+			if (it->second == field) Error("Field set more than once: " + field->name);
+		Next();
 		Expect(':');
-		Value val = field->value;
-		ParseAnyValue(val, field);
+		auto val = ParseAnyValue(field->value.type, field);
 		field_stack_.push_back(std::make_pair(val, field));
 		fieldn++;
 		if (IsNext('}')) break;
@@ -389,27 +582,28 @@ uofs_t Parser::ParseInfo(const StructDef &struct_def) {
 		// Go through elements in reverse, since we're building the data backwards.
 		for (auto it = field_stack_.rbegin();
 			 it != field_stack_.rbegin() + fieldn; ++it) {
-			auto &value = it->first;
+			auto value = it->first;
 			auto field = it->second;
-			if (!struct_def.sortbysize || size == SizeOf(value.type.base_type)) {
-				switch (value.type.base_type) {
+			auto &type = field->value.type;
+			if (!struct_def.sortbysize || size == SizeOf(type.base_type)) {
+				switch (type.base_type) {
 					#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) \
 						case BASE_TYPE_ ## ENUM: \
 							builder_.Pad(field->padding); \
-							builder_.AddElement(value.offset, \
-												atot<CTYPE>(value.constant.c_str()), \
-												atot<CTYPE>(field->value.constant.c_str())); \
+							builder_.AddElement(field->value.offset, \
+												ValueAs<CTYPE>(value), \
+												ValueAs<CTYPE>(field->default_value)); \
 							break;
 						MEGREZ_GEN_TYPES_SCALAR(MEGREZ_TD);
 					#undef MEGREZ_TD
 					#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) \
 						case BASE_TYPE_ ## ENUM: \
 							builder_.Pad(field->padding); \
-							if (IsStruct(field->value.type)) { \
-								SerializeStruct(*field->value.type.struct_def, value); \
+							if (IsStruct(type)) { \
+								SerializeStruct(*type.struct_def, value); \
+								builder_.AddStructOffset(field->value.offset, builder_.GetSize()); \
 							} else { \
-								builder_.AddOffset(value.offset, \
-								atot<CTYPE>(value.constant.c_str())); \
+								builder_.AddOffset(field->value.offset, ValueAs<CTYPE>(value)); \
 							} \
 							break;
 						MEGREZ_GEN_TYPES_POINTER(MEGREZ_TD);
@@ -418,7 +612,7 @@ uofs_t Parser::ParseInfo(const StructDef &struct_def) {
 			}
 		}
 	}
-	for (size_t i = 0; i < fieldn; i++) field_stack_.pop_back();
+	field_stack_.resize(field_stack_.size() - fieldn);
 
 	if (struct_def.fixed) {
 		builder_.ClearOffsets();
@@ -439,9 +633,7 @@ uofs_t Parser::ParseInfo(const StructDef &struct_def) {
 uofs_t Parser::ParseVector(const Type &type) {
 	int count = 0;
 	if (token_ != ']') for (;;) {
-		Value val;
-		val.type = type;
-		ParseAnyValue(val, NULL);
+		auto val = ParseAnyValue(type, nullptr);
 		field_stack_.push_back(std::make_pair(val, nullptr));
 		count++;
 		if (token_ == ']') break;
@@ -449,15 +641,26 @@ uofs_t Parser::ParseVector(const Type &type) {
 	}
 	Next();
 
-	builder_.StartVector(count * InlineSize(type), InlineAlignment((type)));
+	if (type.base_type == BASE_TYPE_STRUCT && type.struct_def->has_key)
+		SortByKey(*type.struct_def, count);
+
+	return SerializeVector(type, count);
+}
+
+// Write the last `count` values of field_stack_ as a vector.
+uofs_t Parser::SerializeVector(const Type &type, int count) {
+	// StartVector aligns to the element size, which for structs is the
+	// struct alignment times a whole number of units.
+	auto alignment = InlineAlignment(type);
+	builder_.StartVector(count * InlineSize(type) / alignment, alignment);
 	for (int i = 0; i < count; i++) {
 		// start at the back, since we're building the data backwards.
-		auto &val = field_stack_.back().first;
-		switch (val.type.base_type) {
+		auto val = field_stack_.back().first;
+		switch (type.base_type) {
 			#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) \
 				case BASE_TYPE_ ## ENUM: \
-					if (IsStruct(val.type)) SerializeStruct(*val.type.struct_def, val); \
-					else builder_.PushElement(atot<CTYPE>(val.constant.c_str())); \
+					if (IsStruct(type)) SerializeStruct(*type.struct_def, val); \
+					else builder_.PushElement(ValueAs<CTYPE>(val)); \
 					break;
 				MEGREZ_GEN_TYPES(MEGREZ_TD)
 			#undef MEGREZ_TD
@@ -469,12 +672,100 @@ uofs_t Parser::ParseVector(const Type &type) {
 	return builder_.EndVector(count);
 }
 
+// A map is given as a JSON object. String keys are quoted, integer keys may
+// be given either way.
+uofs_t Parser::ParseMap(const Type &type) {
+	Expect('{');
+	auto key_type = type.KeyType();
+	std::vector<DataValue> keys;
+	std::vector<uint32_t> hashes;
+	// Keys must be unique, as for MegrezBuilder::CreateMap.
+	std::unordered_set<std::string> string_keys;
+	std::unordered_set<int64_t> int_keys;
+	int count = 0;
+	if (token_ != '}') for (;;) {
+		DataValue key;
+		if (IsString(key_type.base_type)) {
+			if (token_ != kTokenStringConstant) Expect(kTokenStringConstant);
+			if (!string_keys.insert(attribute_).second)
+				Error("Map key set more than once: " + attribute_);
+			hashes.push_back(MapKey<Offset<String>>::Hash(attribute_));
+			key.o = builder_.CreateString(attribute_).o;
+			Next();
+		} else {
+			if (token_ == kTokenStringConstant) token_ = kTokenIntegerConstant;
+			auto text = attribute_;
+			key = ParseScalar(key_type.base_type);
+			if (!int_keys.insert(key.i).second) Error("Map key set more than once: " + text);
+			// Hashed at the width of the key, as MapKey hashes it.
+			switch (SizeOf(key_type.base_type)) {
+				case 1: hashes.push_back(MapKey<int8_t>::Hash(static_cast<int8_t>(key.i))); break;
+				case 2: hashes.push_back(MapKey<int16_t>::Hash(static_cast<int16_t>(key.i))); break;
+				case 4: hashes.push_back(MapKey<int32_t>::Hash(static_cast<int32_t>(key.i))); break;
+				default: hashes.push_back(MapKey<int64_t>::Hash(key.i)); break;
+			}
+		}
+		keys.push_back(key);
+		Expect(':');
+		auto val = ParseAnyValue(type.VectorType(), nullptr);
+		field_stack_.push_back(std::make_pair(val, nullptr));
+		count++;
+		if (token_ == '}') break;
+		Expect(',');
+	}
+	Next();
+
+	auto values = SerializeVector(type.VectorType(), count);
+	for (auto it = keys.begin(); it != keys.end(); ++it)
+		field_stack_.push_back(std::make_pair(*it, nullptr));
+	auto keys_vec = SerializeVector(key_type, count);
+	auto slots = builder_.CreateMapSlots(hashes.data(), hashes.size());
+	return builder_.CreateMap(slots, Offset<Vector<Offset<void>>>(keys_vec),
+							  Offset<Vector<Offset<void>>>(values)).o;
+}
+
+static bool KeyLessThan(const FieldDef &key, const Info *a, const Info *b) {
+	auto field = static_cast<vofs_t>(key.value.offset);
+	switch (key.value.type.base_type) {
+		case BASE_TYPE_STRING: {
+			auto sa = a->GetPointer<const String *>(field);
+			auto sb = b->GetPointer<const String *>(field);
+			return (sa ? sa->view() : StringRef()) < (sb ? sb->view() : StringRef());
+		}
+		#define MEGREZ_TD(ENUM, IDLTYPE, CTYPE) \
+			case BASE_TYPE_ ## ENUM: { \
+				auto def = ValueAs<CTYPE>(key.default_value); \
+				return a->GetField<CTYPE>(field, def) < b->GetField<CTYPE>(field, def); \
+			}
+			MEGREZ_GEN_TYPES_SCALAR(MEGREZ_TD)
+		#undef MEGREZ_TD
+		default:
+			return false;
+	}
+}
+
+// Order the last `count` infos of a vector by their key, the way
+// MegrezBuilder::CreateVectorOfSortedInfos does for generated code.
+void Parser::SortByKey(const StructDef &struct_def, int count) {
+	const FieldDef *key = nullptr;
+	for (auto it = struct_def.fields.vec.begin(); it != struct_def.fields.vec.end(); ++it)
+		if ((*it)->key) key = *it;
+	auto info = [this](DataValue val) {
+		return reinterpret_cast<const Info *>(builder_.GetBufferPointer() +
+			builder_.GetSize() - val.o);
+	};
+	std::stable_sort(field_stack_.end() - count, field_stack_.end(),
+		[&](const std::pair<DataValue, FieldDef *> &a, const std::pair<DataValue, FieldDef *> &b) {
+			return KeyLessThan(*key, info(a.first), info(b.first));
+		});
+}
+
 void Parser::ParseMetaData(Definition &def) {
 	if (IsNext('(')) {
 		for (;;) {
 			auto name = attribute_;
 			Expect(kTokenIdentifier);
-			auto e = new Value();
+			auto e = NewDef<Value>();
 			def.attributes.Add(name, e);
 			if (IsNext(':')) { ParseSingleValue(*e); }
 			if (IsNext(')')) { break; }
@@ -529,12 +820,19 @@ void Parser::ParseSingleValue(Value &e) {
 	}
 }
 
+// Definitions are placed in the arena, which frees them all at once
+// instead of one allocation at a time.
+template<typename T, typename... Args>
+T *Parser::NewDef(Args &&...args) {
+	return new (arena_.allocate(sizeof(T))) T(std::forward<Args>(args)...);
+}
+
 StructDef *Parser::LookupCreateStruct(const std::string &name) {
 	auto struct_def = structs_.Lookup(name);
 	if (!struct_def) {
 		// Rather than failing, we create a "pre declared" StructDef, due to
 		// circular references, and check for errors at the end of parsing.
-		struct_def = new StructDef();
+		struct_def = NewDef<StructDef>();
 		structs_.Add(name, struct_def);
 		struct_def->name = name;
 		struct_def->predecl = true;
@@ -547,10 +845,11 @@ void Parser::ParseEnum(bool is_union) {
 	Next();
 	std::string name = attribute_;
 	Expect(kTokenIdentifier);
-	auto &enum_def = *new EnumDef();
+	auto &enum_def = *NewDef<EnumDef>();
 	enum_def.name = name;
 	enum_def.doc_comment = dc;
 	enum_def.is_union = is_union;
+	enum_def.name_space = name_space_;
 	if (enums_.Add(name, &enum_def)) Error("Enum already exists: " + name);
 	if (is_union) {
 		enum_def.underlying_type.base_type = BASE_TYPE_UTYPE;
@@ -566,13 +865,13 @@ void Parser::ParseEnum(bool is_union) {
 	}
 	ParseMetaData(enum_def);
 	Expect('{');
-	if (is_union) enum_def.vals.Add("NONE", new EnumVal("NONE", 0));
+	if (is_union) enum_def.vals.Add("NONE", NewDef<EnumVal>("NONE", 0));
 	do {
 		std::string name = attribute_;
 		std::string dc = doc_comment_;
 		Expect(kTokenIdentifier);
 		auto prevsize = enum_def.vals.vec.size();
-		auto &ev = *new EnumVal(name, static_cast<int>(
+		auto &ev = *NewDef<EnumVal>(name, static_cast<int>(
 											enum_def.vals.vec.size()
 												? enum_def.vals.vec.back()->value + 1
 												: 0));
@@ -602,12 +901,15 @@ void Parser::ParseDecl() {
 	if (!struct_def.predecl) Error("Datatype already exists: " + name);
 	struct_def.predecl = false;
 	struct_def.name = name;
+	struct_def.name_space = name_space_;
 	struct_def.doc_comment = dc;
 	struct_def.fixed = fixed;
-	// Move this struct to the back of the vector just in case it was predeclared,
-	// to preserve declartion order.
-	remove(structs_.vec.begin(), structs_.vec.end(), &struct_def);
-	structs_.vec.back() = &struct_def;
+	// Move this struct to the back of the vector if it was predeclared, to
+	// preserve declaration order. Structs first seen here are there already.
+	if (structs_.vec.back() != &struct_def) {
+		remove(structs_.vec.begin(), structs_.vec.end(), &struct_def);
+		structs_.vec.back() = &struct_def;
+	}
 	ParseMetaData(struct_def);
 	struct_def.sortbysize =
 		struct_def.attributes.Lookup("Original_order") == nullptr && !fixed;
@@ -633,63 +935,222 @@ bool Parser::SetMainType(const char *name) {
 	return main_struct_def != nullptr;
 }
 
-bool Parser::Parse(const char *source) {
-	source_ = cursor_ = source;
-	line_ = 1;
+bool Parser::Parse(const char *source, const char *source_filename) {
+	std::string filename = source_filename ? source_filename : "";
 	error_.clear();
 	builder_.Clear();
 	try {
-		Next();
-		while (token_ != kTokenEof) {
-			if (token_ == kTokenNameSpace) {
-				Next();
-				for (;;) {
-					name_space_.push_back(attribute_);
-					Expect(kTokenIdentifier);
-					if (!IsNext('.')) break;
-				}
-				Expect(';');
-			} else if (token_ == '{') {
-				if (!main_struct_def) Error("No main type set to parse json with");
-				if (builder_.GetSize()) {
-					Error("Cannot have more than one json object in a file");
-				}
-				builder_.Finish(Offset<Info>(ParseInfo(*main_struct_def)));
-			} else if (token_ == kTokenEnum) {
-				ParseEnum(false);
-			} else if (token_ == kTokenUnion) {
-				ParseEnum(true);
-			} else if (token_ == kTokenMainType) {
-				Next();
-				auto Main = attribute_;
+		ParseFile(source, filename, &includes_);
+	} catch (const std::string &msg) {
+		// Errors in an included file name it, and leave it as the file being parsed.
+		error_ = file_being_parsed_ == filename
+			? "Line " + NumToString(line_) + ": " + msg
+			: file_being_parsed_ + ", line " + NumToString(line_) + ": " + msg;
+		file_being_parsed_ = filename;
+		field_stack_.clear();
+		struct_stack_.clear();
+		return false;
+	}
+	assert(!struct_stack_.size());
+	return true;
+}
+
+void Parser::ParseFile(const char *source, const std::string &filename,
+					   std::vector<std::string> *includes) {
+	source_ = cursor_ = source;
+	line_ = 1;
+	file_being_parsed_ = filename;
+	if (!filename.empty()) {
+		included_files_.insert(AbsolutePath(filename));
+		parsed_files_.insert(AbsolutePath(filename));
+	}
+	Next();
+	while (token_ == kTokenInclude) ParseInclude(includes);
+	while (token_ != kTokenEof) {
+		if (token_ == kTokenNameSpace) {
+			Next();
+			name_space_.clear();
+			for (;;) {
+				name_space_.push_back(attribute_);
 				Expect(kTokenIdentifier);
-				Expect(';');
-				if (!SetMainType(Main.c_str()))
-					Error("Unknown main type: " + Main);
-				if (main_struct_def->fixed)
-					Error("Main type must be a info");
-			} else {
-				ParseDecl();
+				if (!IsNext('.')) break;
+			}
+			Expect(';');
+		} else if (token_ == '{') {
+			if (!main_struct_def) Error("No main type set to parse json with");
+			if (builder_.GetSize()) {
+				Error("Cannot have more than one json object in a file");
 			}
+			builder_.Finish(Offset<Info>(ParseInfo(*main_struct_def)));
+		} else if (token_ == kTokenEnum) {
+			ParseEnum(false);
+		} else if (token_ == kTokenUnion) {
+			ParseEnum(true);
+		} else if (token_ == kTokenMainType) {
+			Next();
+			auto Main = attribute_;
+			Expect(kTokenIdentifier);
+			Expect(';');
+			if (!SetMainType(Main.c_str()))
+				Error("Unknown main type: " + Main);
+			if (main_struct_def->fixed)
+				Error("Main type must be a info");
+		} else if (token_ == kTokenInclude) {
+			Error("includes must come before declarations");
+		} else {
+			ParseDecl();
 		}
-		for (auto it = structs_.vec.begin(); it != structs_.vec.end(); ++it) {
-			if ((*it)->predecl)
-				Error("Type referenced but not defined: " + (*it)->name);
+	}
+	// Included files are checked on their own, before the including file goes on.
+	for (auto it = structs_.vec.begin(); it != structs_.vec.end(); ++it) {
+		if ((*it)->predecl)
+			Error("Type referenced but not defined: " + (*it)->name);
+	}
+	for (auto it = enums_.vec.begin(); it != enums_.vec.end(); ++it) {
+		auto &enum_def = **it;
+		if (enum_def.is_union) {
+			for (auto it = enum_def.vals.vec.begin();
+				 it != enum_def.vals.vec.end();
+				 ++it) {
+				auto &val = **it;
+				if (val.struct_def && val.struct_def->fixed)
+					Error("Only info can be union elements: " + val.name);
+			}
 		}
-		for (auto it = enums_.vec.begin(); it != enums_.vec.end(); ++it) {
-			auto &enum_def = **it;
-			if (enum_def.is_union) {
-				for (auto it = enum_def.vals.vec.begin();
-					 it != enum_def.vals.vec.end();
-					 ++it) {
-					auto &val = **it;
-					if (val.struct_def && val.struct_def->fixed)
-						Error("Only info can be union elements: " + val.name);
-				}
+	}
+}
+
+// include "file.mgz"; found next to the including file or on the include
+// paths. Included files keep their own namespace and main type to
+// themselves, and what they declare is left for their own generated code.
+void Parser::ParseInclude(std::vector<std::string> *includes) {
+	Next();
+	auto name = attribute_;
+	Expect(kTokenStringConstant);
+	std::string contents;
+	auto path = StripFileName(file_being_parsed_) + name;
+	for (auto it = opts.include_paths.begin();
+		 !LoadFile(path.c_str(), true, &contents);
+		 ++it) {
+		if (it == opts.include_paths.end()) Error("Unable to load include file: " + name);
+		path = *it + (StripFileName(*it) == *it ? "" : "/") + name;
+	}
+	if (includes) includes->push_back(name);
+	auto abs_path = AbsolutePath(path);
+	const Parser *included = nullptr;
+	if (included_files_.count(abs_path)) {
+		// Parsed already, or being parsed: it includes itself.
+	} else if (include_cache_ &&
+			   include_cache_->Get(abs_path, path, contents, opts, &included) &&
+			   (!included || ShareDefinitions(*included))) {
+		// Parsed once for all the parsers sharing the cache.
+	} else {
+		// Parse it with the lexer of this file set aside, the token after the
+		// file name (';') still to be checked.
+		auto source = source_, cursor = cursor_;
+		auto line = line_;
+		auto token = token_;
+		auto filename = file_being_parsed_;
+		auto name_space = name_space_;
+		auto main_struct_def_saved = main_struct_def;
+		ParseFile(contents.c_str(), path, nullptr);
+		// Shared definitions are, and may be read on other threads.
+		for (auto it = structs_.vec.begin(); it != structs_.vec.end(); ++it)
+			if (!(*it)->generated) (*it)->generated = true;
+		for (auto it = enums_.vec.begin(); it != enums_.vec.end(); ++it)
+			if (!(*it)->generated) (*it)->generated = true;
+		source_ = source;
+		cursor_ = cursor;
+		line_ = line;
+		token_ = token;
+		file_being_parsed_ = filename;
+		name_space_ = name_space;
+		main_struct_def = main_struct_def_saved;
+	}
+	doc_comment_.clear();
+	Expect(';');
+}
+
+// Uses the definitions of an included file, and those of the files it
+// includes, parsed by `included`, unless this parser has parsed one of
+// those files itself (include cycles), or other definitions of their names.
+bool Parser::ShareDefinitions(const Parser &included) {
+	for (auto it = included.included_files_.begin(); it != included.included_files_.end(); ++it)
+		if (parsed_files_.count(*it)) return false;
+	for (auto it = included.structs_.vec.begin(); it != included.structs_.vec.end(); ++it) {
+		auto existing = structs_.Lookup((*it)->name);
+		if (existing && existing != *it) return false;
+	}
+	for (auto it = included.enums_.vec.begin(); it != included.enums_.vec.end(); ++it) {
+		auto existing = enums_.Lookup((*it)->name);
+		if (existing && existing != *it) return false;
+	}
+	for (auto it = included.structs_.vec.begin(); it != included.structs_.vec.end(); ++it)
+		if (!structs_.Lookup((*it)->name)) structs_.AddShared((*it)->name, *it);
+	for (auto it = included.enums_.vec.begin(); it != included.enums_.vec.end(); ++it)
+		if (!enums_.Lookup((*it)->name)) enums_.AddShared((*it)->name, *it);
+	included_files_.insert(included.included_files_.begin(), included.included_files_.end());
+	return true;
+}
+
+bool IncludeCache::Get(const std::string &path, const std::string &filename,
+					   const std::string &contents, const IDLOptions &opts,
+					   const Parser **parser) {
+	// Held while parsing, so that a file's includes are found on this
+	// thread, and other threads wait for them rather than parse them too.
+	std::lock_guard<std::recursive_mutex> lock(mutex_);
+	*parser = nullptr;
+	auto it = parsers_.find(path);
+	if (it != parsers_.end()) {
+		*parser = it->second.get();
+		return *parser != nullptr;
+	}
+	if (parsing_.count(path)) return true;
+	parsing_.insert(path);
+	std::unique_ptr<Parser> included(new Parser(this));
+	included->opts = opts;
+	if (included->Parse(contents.c_str(), filename.c_str())) {
+		for (auto it = included->structs_.vec.begin(); it != included->structs_.vec.end(); ++it)
+			if (!(*it)->generated) (*it)->generated = true;
+		for (auto it = included->enums_.vec.begin(); it != included->enums_.vec.end(); ++it)
+			if (!(*it)->generated) (*it)->generated = true;
+	} else {
+		included.reset();
+	}
+	parsing_.erase(path);
+	*parser = included.get();
+	parsers_[path] = std::move(included);
+	return *parser != nullptr;
+}
+
+bool Parser::ParseJson(const char *json) { return ParseData(json, nullptr); }
+
+bool Parser::ParseJsonLines(const char *json, BatchBuilder *batch) {
+	return ParseData(json, batch);
+}
+
+bool Parser::ParseData(const char *json, BatchBuilder *batch) {
+	source_ = cursor_ = json;
+	line_ = 1;
+	error_.clear();
+	builder_.Clear();
+	try {
+		if (!main_struct_def) Error("No main type set to parse json with");
+		Next();
+		if (batch) {
+			while (token_ != kTokenEof) {
+				builder_.Clear();
+				builder_.FinishSizePrefixed(Offset<Info>(ParseInfo(*main_struct_def)));
+				batch->AddFinished(builder_);
 			}
+		} else {
+			builder_.Finish(Offset<Info>(ParseInfo(*main_struct_def)));
+			if (token_ != kTokenEof) Error("Cannot have more than one json object in a file");
 		}
 	} catch (const std::string &msg) {
 		error_ = "Line " + NumToString(line_) + ": " + msg;
+		field_stack_.clear();
+		struct_stack_.clear();
 		return false;
 	}
 	assert(!struct_stack_.size());
@@ -0,0 +1,145 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_ALLOCATOR_H_
+#define MEGREZ_ALLOCATOR_H_
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <vector>
+#include "megrez/basic.h"
+
+namespace megrez {
+
+// Memory source of vector_downward. Buffers are filled from the back, so
+// growing a block has to keep the bytes in use at the end of the new block.
+class Allocator {
+ public:
+	virtual ~Allocator() {}
+	virtual uint8_t *allocate(size_t size) = 0;
+	virtual void deallocate(uint8_t *p, size_t size) = 0;
+
+	// Grow `old_p` from `old_size` to `new_size` bytes, keeping its last
+	// `in_use_back` bytes at the end of the returned block. Override this when
+	// the allocator is able to grow a block in place.
+	virtual uint8_t *reallocate_downward(uint8_t *old_p, size_t old_size,
+										 size_t new_size, size_t in_use_back) {
+		assert(new_size > old_size && in_use_back <= old_size);
+		auto new_p = allocate(new_size);
+		memcpy(new_p + new_size - in_use_back,
+			   old_p + old_size - in_use_back,
+			   in_use_back);
+		deallocate(old_p, old_size);
+		return new_p;
+	}
+};
+
+// Plain heap allocation, used when no allocator is given to the builder.
+class DefaultAllocator : public Allocator {
+ public:
+	uint8_t *allocate(size_t size) override { return new uint8_t[size]; }
+	void deallocate(uint8_t *p, size_t) override { delete[] p; }
+
+	static DefaultAllocator &instance() {
+		static DefaultAllocator allocator;
+		return allocator;
+	}
+};
+
+// Bump allocator over large chunks. Only the most recent block can be freed
+// or grown in place, everything else is given back by Reset() or when the
+// arena is destroyed. Not thread safe: use one arena per thread.
+class ArenaAllocator : public Allocator {
+ private:
+	struct Chunk {
+		uint8_t *data;
+		size_t size;
+		size_t used;
+	};
+	std::vector<Chunk> chunks_;
+	size_t chunk_size_;
+	uint8_t *last_;  // most recent allocation
+
+	static size_t AlignUp(size_t size) {
+		const size_t align = sizeof(max_scalar_t) * 2;
+		return (size + align - 1) & ~(align - 1);
+	}
+
+	void NewChunk(size_t size) {
+		Chunk chunk = { new uint8_t[size], size, 0 };
+		chunks_.push_back(chunk);
+	}
+
+ public:
+	explicit ArenaAllocator(size_t chunk_size = 1 << 16)
+		: chunk_size_(AlignUp(chunk_size)), last_(nullptr) {}
+	ArenaAllocator(const ArenaAllocator &) = delete;
+	ArenaAllocator &operator=(const ArenaAllocator &) = delete;
+	~ArenaAllocator() {
+		for (auto it = chunks_.begin(); it != chunks_.end(); ++it) delete[] it->data;
+	}
+
+	uint8_t *allocate(size_t size) override {
+		size = AlignUp(size);
+		if (chunks_.empty() || chunks_.back().size - chunks_.back().used < size)
+			NewChunk(std::max(size, chunk_size_));
+		auto &chunk = chunks_.back();
+		last_ = chunk.data + chunk.used;
+		chunk.used += size;
+		return last_;
+	}
+
+	void deallocate(uint8_t *p, size_t size) override {
+		if (p != last_) return;
+		chunks_.back().used -= AlignUp(size);
+		last_ = nullptr;
+	}
+
+	uint8_t *reallocate_downward(uint8_t *old_p, size_t old_size,
+								 size_t new_size, size_t in_use_back) override {
+		if (old_p == last_) {
+			auto &chunk = chunks_.back();
+			auto extra = AlignUp(new_size) - AlignUp(old_size);
+			if (chunk.size - chunk.used >= extra) {
+				chunk.used += extra;
+				memmove(old_p + new_size - in_use_back,
+						old_p + old_size - in_use_back,
+						in_use_back);
+				return old_p;
+			}
+		}
+		return Allocator::reallocate_downward(old_p, old_size, new_size, in_use_back);
+	}
+
+	// Drop every allocation at once, keeping the first chunk for reuse.
+	void Reset() {
+		for (size_t i = 1; i < chunks_.size(); i++) delete[] chunks_[i].data;
+		if (chunks_.size() > 1) chunks_.resize(1);
+		if (chunks_.size()) chunks_[0].used = 0;
+		last_ = nullptr;
+	}
+
+	size_t BytesReserved() const {
+		size_t total = 0;
+		for (auto it = chunks_.begin(); it != chunks_.end(); ++it) total += it->size;
+		return total;
+	}
+};
+
+} // namespace megrez
+
+#endif // MEGREZ_ALLOCATOR_H_
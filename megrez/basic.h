@@ -20,6 +20,10 @@ limitations under the License.
 #include <assert.h>
 #include <stdint.h>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 
 #if __cplusplus <= 199711L && \
 		(!defined(_MSC_VER) || _MSC_VER < 1600) && \
@@ -30,6 +34,7 @@ limitations under the License.
 #endif
 
 #if !defined(MEGREZ_LITTLEENDIAN)
+	#define MEGREZ_ENDIAN_DETECTED 1
 	#if defined(__GNUC__) || defined(__clang__)
 		#ifdef __BIG_ENDIAN__
 			#define MEGREZ_LITTLEENDIAN 0
@@ -43,6 +48,14 @@ limitations under the License.
 	#endif
 #endif // !defined(MEGREZ_LITTLEENDIAN)
 
+// Width of offsets and vector lengths. 64 lifts the 2GiB limit on buffers
+// at the cost of larger references, 16 halves the references of messages
+// smaller than 32KiB. Everything reading or writing a buffer has to be
+// compiled with the same value, generated headers check this.
+#if !defined(MEGREZ_OFFSET_BITS)
+	#define MEGREZ_OFFSET_BITS 32
+#endif // !defined(MEGREZ_OFFSET_BITS)
+
 #define MEGREZ_VERSION_MAJOR 0
 #define MEGREZ_VERSION_MINOR 0
 #define MEGREZ_VERSION_REVISION 6
@@ -53,11 +66,32 @@ limitations under the License.
 
 namespace megrez {
 
-typedef uint32_t uofs_t;
-typedef int32_t sofs_t;
+#if MEGREZ_OFFSET_BITS == 64
+	typedef uint64_t uofs_t;
+	typedef int64_t sofs_t;
+#elif MEGREZ_OFFSET_BITS == 32
+	typedef uint32_t uofs_t;
+	typedef int32_t sofs_t;
+#elif MEGREZ_OFFSET_BITS == 16
+	typedef uint16_t uofs_t;
+	typedef int16_t sofs_t;
+#else
+	#error MEGREZ_OFFSET_BITS must be 16, 32 or 64.
+#endif // MEGREZ_OFFSET_BITS
 typedef uint16_t vofs_t;
 typedef uintmax_t max_scalar_t;
 
+// Largest buffer the offsets can address: the distance from an info back
+// to its vtable has to fit in a sofs_t.
+const size_t kMaxBufferSize = static_cast<size_t>(std::numeric_limits<sofs_t>::max());
+
+// Limits on sizes given by the caller. Checked in release builds too, since
+// going on past them would write outside the buffer.
+inline void CheckLimit(bool within_limit) {
+	assert(within_limit);
+	if (!within_limit) std::abort();
+}
+
 template<typename T> 
 struct Offset {
 	uofs_t o;
@@ -66,10 +100,15 @@ struct Offset {
 	Offset<void> Union() const { return Offset<void>(o); }
 };
 
+// Only checked when the byte order was detected: defining
+// MEGREZ_LITTLEENDIAN=0 by hand runs the byte swapping code on a
+// little-endian machine, which is how that code is tested.
 inline void EndianCheck() {
-	int endiantest = 1;
-	assert(*reinterpret_cast<char *>(&endiantest) == MEGREZ_LITTLEENDIAN);
-	(void)endiantest;
+	#ifdef MEGREZ_ENDIAN_DETECTED
+		int endiantest = 1;
+		assert(*reinterpret_cast<char *>(&endiantest) == MEGREZ_LITTLEENDIAN);
+		(void)endiantest;
+	#endif
 }
 
 template<typename T> 
@@ -94,46 +133,98 @@ T EndianScalar(T t) {
 	#endif
 }
 
-template<typename T> 
+// Read policies: how scalars are loaded from and stored into a buffer.
+// AlignedReads dereferences the pointer, so every scalar must be naturally
+// aligned, as it is in a buffer at an aligned address. UnalignedReads goes
+// through memcpy, which is defined for any address and compiles to a single
+// load or store on CPUs that allow unaligned access, such as x86.
+struct AlignedReads {
+	template<typename T> 
+	static T Load(const void *p) { return *reinterpret_cast<const T *>(p); }
+	template<typename T> 
+	static void Store(void *p, T t) { *reinterpret_cast<T *>(p) = t; }
+};
+
+struct UnalignedReads {
+	template<typename T> 
+	static T Load(const void *p) {
+		T t;
+		memcpy(&t, p, sizeof(T));
+		return t;
+	}
+	template<typename T> 
+	static void Store(void *p, T t) { memcpy(p, &t, sizeof(T)); }
+};
+
+// The type reading a T with another policy: Vector, String and Map
+// specialize this, so the elements of a vector read with UnalignedReads
+// are read with UnalignedReads as well.
+template<typename T, typename ReadPolicy> 
+struct WithReadPolicy {
+	typedef T type;
+};
+
+template<typename T, typename ReadPolicy = AlignedReads> 
 T ReadScalar(const void *p) {
-	return EndianScalar(*reinterpret_cast<const T *>(p));
+	return EndianScalar(ReadPolicy::template Load<T>(p));
 }
 
-template<typename T> 
+template<typename T, typename ReadPolicy = AlignedReads> 
 void WriteScalar(void *p, T t) {
-	*reinterpret_cast<T *>(p) = EndianScalar(t);
+	ReadPolicy::Store(p, EndianScalar(t));
 }
 
+// Alignment of a T inside a buffer. Structs generated with --unaligned-reads
+// are declared with alignment 1, so they may be accessed at any address, and
+// keep the alignment the builder gives them in kBufferAlignment.
+template<typename T, typename Enable = void> 
+struct BufferAlignment {
+	static size_t value() {
+		#ifdef _MSC_VER
+			return __alignof(T);
+		#else
+			return alignof(T);
+		#endif
+	}
+};
+
 template<typename T> 
-size_t AlignOf() {
-	#ifdef _MSC_VER
-		return __alignof(T);
-	#else
-		return alignof(T);
-	#endif
-}
+struct BufferAlignment<T, typename std::enable_if<(T::kBufferAlignment > 0)>::type> {
+	static size_t value() { return T::kBufferAlignment; }
+};
 
 template<typename T> 
+size_t AlignOf() { return BufferAlignment<T>::value(); }
+
+template<typename T, typename ReadPolicy = AlignedReads> 
 struct IndirectHelper {
 	typedef T return_type;
+	typedef const T *data_type;
+	static const size_t element_size = sizeof(T);
+	static size_t element_alignment() { return AlignOf<T>(); }
 	static return_type Read(const uint8_t *p, uofs_t i) {
-		return EndianScalar((reinterpret_cast<const T *>(p))[i]);
+		return ReadScalar<T, ReadPolicy>(p + i * sizeof(T));
 	}
 };
 
-template<typename T> 
-struct IndirectHelper<Offset<T>> {
-	typedef const T *return_type;
+template<typename T, typename ReadPolicy> 
+struct IndirectHelper<Offset<T>, ReadPolicy> {
+	typedef const typename WithReadPolicy<T, ReadPolicy>::type *return_type;
+	typedef const uofs_t *data_type;  // the raw, relative offsets
+	static const size_t element_size = sizeof(uofs_t);
+	static size_t element_alignment() { return AlignOf<uofs_t>(); }
 	static return_type Read(const uint8_t *p, uofs_t i) {
 		p += i * sizeof(uofs_t);
-		return EndianScalar(reinterpret_cast<return_type>(
-				p + ReadScalar<uofs_t>(p)));
+		return reinterpret_cast<return_type>(p + ReadScalar<uofs_t, ReadPolicy>(p));
 	}
 };
 
-template<typename T> 
-struct IndirectHelper<const T *> {
+template<typename T, typename ReadPolicy> 
+struct IndirectHelper<const T *, ReadPolicy> {
 	typedef const T &return_type;
+	typedef const T *data_type;
+	static const size_t element_size = sizeof(T);
+	static size_t element_alignment() { return AlignOf<T>(); }
 	static return_type Read(const uint8_t *p, uofs_t i) {
 		return *reinterpret_cast<const T *>(p + i * sizeof(T));
 	}
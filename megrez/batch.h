@@ -0,0 +1,117 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_BATCH_H_
+#define MEGREZ_BATCH_H_
+
+#include <cstring>
+#include <vector>
+#include "megrez/basic.h"
+#include "megrez/builder.h"
+#include "megrez/util.h"
+
+namespace megrez {
+
+// Messages in a batch start on this boundary. The gap after a message is
+// zero padding and isn't counted by its size prefix.
+const size_t kBatchAlignment = sizeof(max_scalar_t);
+
+// Collects size-prefixed messages back to back in one buffer, e.g. to hand
+// many small messages to a single write(). Both the builder and the batch
+// memory are reused after Clear(), so a warm batch doesn't allocate.
+// Each message is built on its own and then copied over: building them in
+// one downward buffer would leave them in reverse order.
+class BatchBuilder {
+ private:
+	MegrezBuilder builder_;
+	std::vector<uint8_t> batch_;
+	size_t count_;
+
+ public:
+	explicit BatchBuilder(uofs_t message_size = 1024, Allocator *allocator = nullptr)
+		: builder_(message_size, allocator), count_(0) {}
+
+	// Build each message with this builder, then call Finish() with its root.
+	MegrezBuilder &builder() { return builder_; }
+
+	template<typename T> 
+	void Finish(Offset<T> root) {
+		builder_.FinishSizePrefixed(root);
+		AddFinished(builder_);
+		builder_.Clear();
+	}
+
+	// Append the message another builder finished with FinishSizePrefixed.
+	void AddFinished(const MegrezBuilder &builder) {
+		auto size = builder.GetSize();
+		auto at = batch_.size();
+		batch_.resize(at + size + PaddingBytes(size, kBatchAlignment));
+		memcpy(batch_.data() + at, builder.GetBufferPointer(), size);
+		count_++;
+	}
+
+	void Reserve(size_t bytes) { batch_.reserve(bytes); }
+	void Clear() {
+		batch_.clear();
+		count_ = 0;
+	}
+
+	const uint8_t *data() const { return batch_.data(); }
+	size_t size() const { return batch_.size(); }
+	size_t count() const { return count_; }
+};
+
+// Walks the messages of a batch or stream in place. A message cut off at the
+// end of the data is left alone, consumed() tells where it starts so the
+// caller can keep those bytes for the next read.
+class BatchReader {
+ private:
+	const uint8_t *begin_;
+	const uint8_t *cur_;
+	const uint8_t *end_;
+
+ public:
+	BatchReader(const void *buf, size_t size)
+		: begin_(reinterpret_cast<const uint8_t *>(buf)),
+			cur_(begin_),
+			end_(begin_ + size) {}
+
+	// Sets `message` to the bytes after the size prefix, ready for GetRoot.
+	bool Next(const uint8_t **message, uofs_t *size) {
+		if (static_cast<size_t>(end_ - cur_) < sizeof(uofs_t)) return false;
+		auto message_size = GetPrefixedSize(cur_);
+		if (static_cast<size_t>(end_ - cur_) - sizeof(uofs_t) < message_size) return false;
+		*message = cur_ + sizeof(uofs_t);
+		*size = message_size;
+		size_t total = sizeof(uofs_t) + message_size;
+		total += PaddingBytes(total, kBatchAlignment);
+		cur_ = static_cast<size_t>(end_ - cur_) < total ? end_ : cur_ + total;
+		return true;
+	}
+
+	template<typename T> 
+	const T *Next() {
+		const uint8_t *message;
+		uofs_t size;
+		return Next(&message, &size) ? GetRoot<T>(message) : nullptr;
+	}
+
+	size_t consumed() const { return cur_ - begin_; }
+};
+
+} // namespace megrez
+
+#endif // MEGREZ_BATCH_H_
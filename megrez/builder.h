@@ -20,6 +20,10 @@ limitations under the License.
 #include <assert.h>
 #include <vector>
 #include <type_traits>
+#include <unordered_map>
+#include "megrez/allocator.h"
+#include "megrez/endian.h"
+#include "megrez/map.h"
 #include "megrez/vector.h"
 #include "megrez/string.h"
 #include "megrez/basic.h"
@@ -32,17 +36,40 @@ class MegrezBuilder {
 	struct FieldLoc {
 		uofs_t off;
 		vofs_t id;
+		bool is_offset;  // refers to another object
+	};
+	// An info that has been started but not ended. Children may be created
+	// while infos are open: the bytes of the innermost one are then moved to
+	// lifted_ until one of its fields is added again.
+	struct InfoFrame {
+		uofs_t start;       // buffer size at the start of the info's object
+		size_t first;       // its first entry in offsetbuf_
+		size_t lifted;      // its bytes at the end of lifted_
+		bool is_lifted;
 	};
 	vector_downward buf_;
 	std::vector<FieldLoc> offsetbuf_;
-	std::vector<uofs_t> vinfo_;
+	std::vector<InfoFrame> infos_;
+	std::vector<uint8_t> lifted_;
+	std::unordered_multimap<uint32_t, uofs_t> vinfo_;  // vtable hash -> offset
+	// Objects created through the Create*Shared/EndSharedInfo calls.
+	std::unordered_multimap<uint32_t, uofs_t> shared_;  // content hash -> offset
+	std::unordered_map<std::string, uofs_t> shared_infos_;
+	std::vector<uofs_t> shared_refs_;
+	std::vector<uofs_t> map_slots_;
+	std::vector<uint32_t> map_hashes_;
+	// Vtables written for fixed infos, keyed by the caller's static copy.
+	std::vector<std::pair<const vofs_t *, uofs_t>> fixed_vtables_;
+	size_t max_shared_;
 	size_t minalign_;
 	bool force_defaults_;
 	const char *Megrez_version_string;
 
  public:
-	explicit MegrezBuilder(uofs_t initial_size = 1024)
-		: buf_(initial_size), minalign_(1), force_defaults_(false) {
+	explicit MegrezBuilder(uofs_t initial_size = 1024,
+						   Allocator *allocator = nullptr)
+		: buf_(initial_size, allocator), max_shared_(4096), minalign_(1),
+			force_defaults_(false) {
 		offsetbuf_.reserve(16);
 		vinfo_.reserve(16);
 		EndianCheck();
@@ -56,11 +83,29 @@ class MegrezBuilder {
 	void Clear() {
 		buf_.clear();
 		offsetbuf_.clear();
+		infos_.clear();
+		lifted_.clear();
 		vinfo_.clear();
+		shared_.clear();
+		shared_infos_.clear();
+		fixed_vtables_.clear();
+		minalign_ = 1;
 	}
 
 	uofs_t GetSize() const { return buf_.size(); }
+
+	// Size the buffer for `bytes` more bytes, so building doesn't reallocate.
+	void Reserve(size_t bytes) { buf_.reserve(bytes); }
+
 	uint8_t *GetBufferPointer() const { return buf_.data(); }
+
+	// Take ownership of the finished buffer without copying it. The builder is
+	// cleared and continues with a fresh block from the same allocator.
+	DetachedBuffer Release() {
+		auto fb = buf_.release();
+		Clear();
+		return fb;
+	}
 	const char *GetVersionString() { return Megrez_version_string; }
 	void ForceDefaults(bool fd) { force_defaults_ = fd; }
 	void Pad(size_t num_bytes) { buf_.fill(num_bytes); }
@@ -93,14 +138,15 @@ class MegrezBuilder {
 		return PushElement(ReferTo(off.o));
 	}
 
-	void TrackField(vofs_t field, uofs_t off) {
-		FieldLoc fl = { off, field };
+	void TrackField(vofs_t field, uofs_t off, bool is_offset = false) {
+		FieldLoc fl = { off, field, is_offset };
 		offsetbuf_.push_back(fl);
 	}
 
 	template<typename T> 
 	void AddElement(vofs_t field, T e, T def) {
 		if (e == def && !force_defaults_) return;
+		Unnest();
 		auto off = PushElement(e);
 		TrackField(field, off);
 	}
@@ -108,18 +154,25 @@ class MegrezBuilder {
 	template<typename T> 
 	void AddOffset(vofs_t field, Offset<T> off) {
 		if (!off.o) return;
-		AddElement(field, ReferTo(off.o), static_cast<uofs_t>(0));
+		Unnest();
+		TrackField(field, PushElement(ReferTo(off.o)), true);
 	}
 
 	template<typename T> 
 	void AddStruct(vofs_t field, const T *structptr) {
 		if (!structptr) return;
+		Unnest();
 		Align(AlignOf<T>());
 		PushBytes(reinterpret_cast<const uint8_t *>(structptr), sizeof(T));
 		TrackField(field, GetSize());
 	}
 
-	void AddStructOffset(vofs_t field, uofs_t off) { TrackField(field, off); }
+	// The struct has just been pushed by the caller, after StartStruct()
+	// put the info's bytes back, so `off` is where the info ends up.
+	void AddStructOffset(vofs_t field, uofs_t off) {
+		assert(infos_.empty() || !infos_.back().is_lifted);
+		TrackField(field, off);
+	}
 
 	uofs_t ReferTo(uofs_t off) {
 		Align(sizeof(uofs_t));
@@ -127,53 +180,188 @@ class MegrezBuilder {
 		return GetSize() - off + sizeof(uofs_t);
 	}
 
-	void NotNested() { assert(!offsetbuf_.size()); }
+	void NotNested() { assert(infos_.empty()); }
+
+	// Called before a child object is written. Moves the bytes of the
+	// innermost open info out of the buffer so the child isn't written into
+	// the middle of it.
+	void Nest() {
+		if (infos_.empty()) return;
+		auto &info = infos_.back();
+		if (info.is_lifted) return;
+		info.is_lifted = true;
+		info.lifted = GetSize() - info.start;
+		lifted_.insert(lifted_.end(), buf_.data(), buf_.data() + info.lifted);
+		buf_.pop(info.lifted);
+	}
+
+	// Put the innermost info's bytes back on top of the children written
+	// since Nest(). They keep their alignment relative to the buffer end, so
+	// only the recorded field positions and the offsets stored in them change.
+	void Unnest() {
+		if (infos_.empty() || !infos_.back().is_lifted) return;
+		auto &info = infos_.back();
+		buf_.fill(PaddingBytes(GetSize() - info.start, minalign_));
+		auto delta = GetSize() - info.start;
+		if (info.lifted) {
+			auto src = lifted_.data() + lifted_.size() - info.lifted;
+			memcpy(buf_.make_space(info.lifted), src, info.lifted);
+			lifted_.resize(lifted_.size() - info.lifted);
+		}
+		for (auto it = offsetbuf_.begin() + info.first; it != offsetbuf_.end(); ++it) {
+			it->off += delta;
+			if (!it->is_offset) continue;
+			auto field = buf_.data_at(it->off);
+			WriteScalar(field, static_cast<uofs_t>(ReadScalar<uofs_t>(field) + delta));
+		}
+		info.start += delta;
+		info.is_lifted = false;
+	}
 
 	uofs_t StartInfo() {
-		NotNested();
+		Nest();
+		InfoFrame info = { GetSize(), offsetbuf_.size(), 0, false };
+		infos_.push_back(info);
 		return GetSize();
 	}
 
+	// `start` is the value returned by StartInfo(). The info may have moved
+	// since then if children were created in between, so the builder uses its
+	// own record of where the object begins.
 	uofs_t EndInfo(uofs_t start, vofs_t numfields) {
+		assert(!infos_.empty());
+		Unnest();
+		start = infos_.back().start;
+		auto first = infos_.back().first;
+		infos_.pop_back();
 		auto vInfoOffsetloc = PushElement<uofs_t>(0);
 		buf_.fill(numfields * sizeof(vofs_t));
 		auto info_object_size = vInfoOffsetloc - start;
 		assert(info_object_size < 0x10000);
 		PushElement<vofs_t>(info_object_size);
 		PushElement<vofs_t>(FieldIndexToOffset(numfields));
-		for (auto field_location = offsetbuf_.begin();
+		for (auto field_location = offsetbuf_.begin() + first;
 							field_location != offsetbuf_.end();
 						++field_location) {
 			auto pos = (vInfoOffsetloc - field_location->off);
 			assert(!ReadScalar<vofs_t>(buf_.data() + field_location->id));
 			WriteScalar<vofs_t>(buf_.data() + field_location->id, pos);
 		}
-		offsetbuf_.clear();
-		auto vt1 = reinterpret_cast<vofs_t *>(buf_.data());
-		auto vt1_size = *vt1;
+		offsetbuf_.resize(first);
+		auto vt1 = buf_.data();
+		auto vt1_size = ReadScalar<vofs_t>(vt1);
+		auto vt1_hash = HashBytes(vt1, vt1_size);
 		auto vt_use = GetSize();
-		for (auto it = vinfo_.begin(); it != vinfo_.end(); ++it) {
-			if (memcmp(buf_.data_at(*it), vt1, vt1_size)) continue;
-			vt_use = *it;
+		auto candidates = vinfo_.equal_range(vt1_hash);
+		for (auto it = candidates.first; it != candidates.second; ++it) {
+			if (memcmp(buf_.data_at(it->second), vt1, vt1_size)) continue;
+			vt_use = it->second;
 			buf_.pop(GetSize() - vInfoOffsetloc);
 			break;
 		}
 		if (vt_use == GetSize()) {
-			vinfo_.push_back(vt_use);
+			vinfo_.insert(std::make_pair(vt1_hash, vt_use));
 		}
 		WriteScalar(buf_.data_at(vInfoOffsetloc),
-								static_cast<sofs_t>(vt_use) -
-									static_cast<sofs_t>(vInfoOffsetloc));
+								static_cast<sofs_t>(static_cast<sofs_t>(vt_use) -
+									static_cast<sofs_t>(vInfoOffsetloc)));
 		return vInfoOffsetloc;
 	}
 
+	// Like EndInfo, but returns an identical info created by an earlier
+	// EndSharedInfo call instead of keeping a second copy. Offset fields are
+	// compared by what they refer to, so infos only match if their children
+	// were shared as well.
+	uofs_t EndSharedInfo(uofs_t start, vofs_t numfields) {
+		assert(!infos_.empty());
+		Unnest();
+		start = infos_.back().start;
+		shared_refs_.clear();
+		for (auto it = offsetbuf_.begin() + infos_.back().first; it != offsetbuf_.end(); ++it)
+			if (it->is_offset) shared_refs_.push_back(it->off);
+		auto vtables = vinfo_.size();
+		auto info = EndInfo(start, numfields);
+		// An info with a new vtable can't have been seen before, but it is
+		// still worth remembering.
+		bool new_vtable = vinfo_.size() != vtables;
+		auto object = buf_.data_at(info);
+		std::string key(reinterpret_cast<const char *>(object), info - start);
+		auto vt_use = static_cast<uofs_t>(info + ReadScalar<sofs_t>(object));
+		WriteScalar(&key[0], vt_use);
+		for (auto it = shared_refs_.begin(); it != shared_refs_.end(); ++it) {
+			auto field = object + (info - *it);
+			WriteScalar(&key[info - *it],
+						static_cast<uofs_t>(*it - ReadScalar<uofs_t>(field)));
+		}
+		if (!new_vtable) {
+			auto found = shared_infos_.find(key);
+			if (found != shared_infos_.end()) {
+				buf_.pop(GetSize() - start);
+				return found->second;
+			}
+		}
+		if (shared_infos_.size() < max_shared_) shared_infos_[key] = info;
+		return info;
+	}
+
+	// Reserve an info whose layout is known up front, with every field
+	// present. `vtable` is the complete vtable in native byte order; its
+	// address identifies it, so it must be static. The object is zeroed
+	// apart from its vtable offset and its fields are written with the
+	// SetFixed* calls below, which skips the per-field bookkeeping and vtable
+	// search of EndInfo.
+	uofs_t ReserveFixedInfo(const vofs_t *vtable, size_t alignment) {
+		Nest();
+		uofs_t vt_use = 0;
+		for (auto it = fixed_vtables_.begin(); it != fixed_vtables_.end(); ++it) {
+			if (it->first == vtable) {
+				vt_use = it->second;
+				break;
+			}
+		}
+		if (!vt_use) {
+			for (auto i = vtable[0] / sizeof(vofs_t); i; ) PushElement(vtable[--i]);
+			vt_use = GetSize();
+			fixed_vtables_.push_back(std::make_pair(vtable, vt_use));
+		}
+		if (alignment > minalign_) minalign_ = alignment;
+		PreAlign(vtable[1], alignment);
+		buf_.fill(vtable[1]);
+		auto info = GetSize();
+		WriteScalar(buf_.data(), static_cast<sofs_t>(static_cast<sofs_t>(vt_use) -
+													 static_cast<sofs_t>(info)));
+		return info;
+	}
+
+	// `field` is the byte offset of the field inside the object, as listed in
+	// the vtable.
+	template<typename T> 
+	void SetFixedField(uofs_t info, vofs_t field, T e) {
+		WriteScalar(buf_.data_at(info) + field, e);
+	}
+
+	template<typename T> 
+	void SetFixedStruct(uofs_t info, vofs_t field, const T &structref) {
+		memcpy(buf_.data_at(info) + field, &structref, sizeof(T));
+	}
+
+	template<typename T> 
+	void SetFixedOffset(uofs_t info, vofs_t field, Offset<T> off) {
+		assert(off.o && off.o <= info - field);
+		WriteScalar(buf_.data_at(info) + field, static_cast<uofs_t>(info - field - off.o));
+	}
+
+	// Structs are written in place, inside the open info if there is one.
 	uofs_t StartStruct(size_t alignment) {
+		Unnest();
 		Align(alignment);
 		return GetSize();
 	}
 
 	uofs_t EndStruct() { return GetSize(); }
-	void ClearOffsets() { offsetbuf_.clear(); }
+	void ClearOffsets() {
+		offsetbuf_.resize(infos_.empty() ? 0 : infos_.back().first);
+	}
 	void PreAlign(size_t len, size_t alignment) {
 		buf_.fill(PaddingBytes(GetSize() + len, alignment));
 	}
@@ -183,22 +371,60 @@ class MegrezBuilder {
 	}
 
 	Offset<String> CreateString(const char *str, size_t len) {
-		NotNested();
+		CheckLimit(len < kMaxBufferSize);
+		Nest();
 		PreAlign<uofs_t>(len + 1);
-		buf_.fill(1);
-		PushBytes(reinterpret_cast<const uint8_t *>(str), len);
+		auto dest = buf_.make_space(len + 1);
+		memcpy(dest, str, len);
+		dest[len] = 0;
 		PushElement(static_cast<uofs_t>(len));
 		return Offset<String>(GetSize());
 	}
 
 	Offset<String> CreateString(const char *str) { return CreateString(str, strlen(str)); }
 	Offset<String> CreateString(const std::string &str) { return CreateString(str.c_str(), str.length()); }
+	Offset<String> CreateString(StringRef str) { return CreateString(str.data(), str.size()); }
+
+	// Look up a string or vector of `bytes` bytes just written at `off`. A
+	// match drops the new copy back to `before` and returns the old one.
+	uofs_t ShareObject(uofs_t before, uofs_t off, size_t bytes, size_t alignment) {
+		auto object = buf_.data_at(off);
+		auto hash = HashBytes(object, bytes);
+		auto candidates = shared_.equal_range(hash);
+		for (auto it = candidates.first; it != candidates.second; ++it) {
+			// The elements of the old copy have to be aligned for this type too.
+			if ((it->second - sizeof(uofs_t)) & (alignment - 1)) continue;
+			if (memcmp(buf_.data_at(it->second), object, bytes)) continue;
+			buf_.pop(GetSize() - before);
+			return it->second;
+		}
+		if (shared_.size() < max_shared_) shared_.insert(std::make_pair(hash, off));
+		return off;
+	}
+
+	// Upper bound for the entries kept by the shared calls. Once it is reached
+	// new objects are still written but not remembered, which keeps the
+	// builder's memory bounded.
+	void SetSharedTableSize(size_t max_entries) { max_shared_ = max_entries; }
+
+	Offset<String> CreateSharedString(const char *str, size_t len) {
+		Nest();
+		auto before = GetSize();
+		auto off = CreateString(str, len).o;
+		return Offset<String>(ShareObject(before, off, sizeof(uofs_t) + len + 1, 1));
+	}
+
+	Offset<String> CreateSharedString(const char *str) { return CreateSharedString(str, strlen(str)); }
+	Offset<String> CreateSharedString(const std::string &str) { return CreateSharedString(str.c_str(), str.length()); }
+	Offset<String> CreateSharedString(StringRef str) { return CreateSharedString(str.data(), str.size()); }
 
 	uofs_t EndVector(size_t len) {
 		return PushElement(static_cast<uofs_t>(len));
 	}
 
 	void StartVector(size_t len, size_t elemsize) {
+		CheckLimit(len <= kMaxBufferSize / elemsize);
+		Nest();
 		PreAlign<uofs_t>(len * elemsize);
 		PreAlign(len * elemsize, elemsize);
 	}
@@ -207,39 +433,172 @@ class MegrezBuilder {
 		return buf_.make_space(len * elemsize);
 	}
 
+	// Copy a whole array of scalars with a single capacity check. The caller
+	// has aligned the buffer with StartVector already.
+	template<typename T> 
+	void PushElements(const T *v, size_t len) {
+		AssertScalarT<T>();
+		if (sizeof(T) > minalign_) minalign_ = sizeof(T);
+		EndianCopy<T>(ReserveElements(len, sizeof(T)), v, len);
+	}
+
+	// Offsets are relative to their own location, so they are pushed one by one.
+	template<typename T> 
+	void PushElements(const Offset<T> *v, size_t len) {
+		for (auto i = len; i; ) PushElement(v[--i]);
+	}
+
 	template<typename T> 
 	Offset<Vector<T>> CreateVector(const T *v, size_t len) {
-		NotNested();
 		StartVector(len, sizeof(T));
-		auto i = len;
-		do {
-			PushElement(v[--i]);
-		} while (i);
+		PushElements(v, len);
 		return Offset<Vector<T>>(EndVector(len));
 	}
 
 	template<typename T> 
 	Offset<Vector<T>> CreateVector(const std::vector<T> &v){
-		return CreateVector(&v[0], v.size());
+		return CreateVector(v.data(), v.size());
+	}
+
+	// Vectors of offsets can't be shared this way, their bytes depend on
+	// where they are written.
+	template<typename T> 
+	Offset<Vector<T>> CreateSharedVector(const T *v, size_t len) {
+		static_assert(std::is_scalar<T>::value, "T must be a scalar type");
+		Nest();
+		auto before = GetSize();
+		auto off = CreateVector(v, len).o;
+		return Offset<Vector<T>>(
+			ShareObject(before, off, sizeof(uofs_t) + len * sizeof(T), sizeof(T)));
+	}
+
+	template<typename T> 
+	Offset<Vector<T>> CreateSharedVector(const std::vector<T> &v) {
+		return CreateSharedVector(v.data(), v.size());
+	}
+
+	template<typename T> 
+	Offset<Vector<const T *>> CreateSharedVectorOfStructs(const T *v, size_t len) {
+		Nest();
+		auto before = GetSize();
+		auto off = CreateVectorOfStructs(v, len).o;
+		return Offset<Vector<const T *>>(
+			ShareObject(before, off, sizeof(uofs_t) + len * sizeof(T), AlignOf<T>()));
+	}
+
+	template<typename T> 
+	Offset<Vector<const T *>> CreateSharedVectorOfStructs(const std::vector<T> &v) {
+		return CreateSharedVectorOfStructs(v.data(), v.size());
+	}
+
+	// Vector of infos ordered by their key field, for Vector::LookupByKey.
+	// The infos have to be finished; `v` is sorted in place.
+	template<typename T> 
+	Offset<Vector<Offset<T>>> CreateVectorOfSortedInfos(Offset<T> *v, size_t len) {
+		std::stable_sort(v, v + len, [this](const Offset<T> &a, const Offset<T> &b) {
+			auto info_a = reinterpret_cast<const T *>(buf_.data_at(a.o));
+			auto info_b = reinterpret_cast<const T *>(buf_.data_at(b.o));
+			return info_a->KeyCompareLessThan(info_b);
+		});
+		return CreateVector(v, len);
+	}
+
+	template<typename T> 
+	Offset<Vector<Offset<T>>> CreateVectorOfSortedInfos(std::vector<Offset<T>> *v) {
+		return CreateVectorOfSortedInfos(v->data(), v->size());
+	}
+
+	// The slots of a map whose entries have these key hashes, see Map.
+	Offset<Vector<uofs_t>> CreateMapSlots(const uint32_t *hashes, size_t len) {
+		auto capacity = MapCapacity(len);
+		map_slots_.assign(capacity, 0);
+		for (size_t i = 0; i < len; i++) {
+			auto slot = hashes[i] & (capacity - 1);
+			while (map_slots_[slot]) slot = (slot + 1) & (capacity - 1);
+			map_slots_[slot] = static_cast<uofs_t>(i + 1);
+		}
+		return CreateVector(map_slots_);
+	}
+
+	template<typename K, typename V> 
+	Offset<Map<K, V>> CreateMap(Offset<Vector<uofs_t>> slots, Offset<Vector<K>> keys,
+								Offset<Vector<V>> values) {
+		Nest();
+		PushElement(values);
+		PushElement(keys);
+		PushElement(slots);
+		return Offset<Map<K, V>>(GetSize());
+	}
+
+	// Map from `len` keys to `len` values. Keys are integers or strings
+	// created beforehand, and must be unique.
+	template<typename K, typename V> 
+	Offset<Map<K, V>> CreateMap(const K *keys, const V *values, size_t len) {
+		auto values_vec = CreateVector(values, len);
+		auto keys_vec = CreateVector(keys, len);
+		auto slots = CreateMapSlots(HashMapKeys(keys, len), len);
+		return CreateMap(slots, keys_vec, values_vec);
+	}
+
+	template<typename K, typename V> 
+	Offset<Map<K, V>> CreateMap(const std::vector<K> &keys, const std::vector<V> &values) {
+		assert(keys.size() == values.size());
+		return CreateMap(keys.data(), values.data(), keys.size());
+	}
+
+	template<typename K, typename T> 
+	Offset<Map<K, const T *>> CreateMapOfStructs(const K *keys, const T *values, size_t len) {
+		auto values_vec = CreateVectorOfStructs(values, len);
+		auto keys_vec = CreateVector(keys, len);
+		auto slots = CreateMapSlots(HashMapKeys(keys, len), len);
+		return CreateMap(slots, keys_vec, values_vec);
+	}
+
+	template<typename K> 
+	const uint32_t *HashMapKeys(const K *keys, size_t len) {
+		map_hashes_.resize(len);
+		for (size_t i = 0; i < len; i++) map_hashes_[i] = HashMapKey(keys[i]);
+		return map_hashes_.data();
+	}
+
+	template<typename K> 
+	uint32_t HashMapKey(K key) { return MapKey<K>::Hash(key); }
+	uint32_t HashMapKey(Offset<String> key) {
+		auto str = reinterpret_cast<const String *>(buf_.data_at(key.o));
+		return MapKey<Offset<String>>::Hash(str->view());
 	}
 
 	template<typename T> 
 	Offset<Vector<const T *>> CreateVectorOfStructs(const T *v, size_t len) {
-		NotNested();
-		StartVector(len, AlignOf<T>());
+		CheckLimit(len <= kMaxBufferSize / sizeof(T));
+		Nest();
+		PreAlign<uofs_t>(len * sizeof(T));
+		PreAlign(len * sizeof(T), AlignOf<T>());
+		if (AlignOf<T>() > minalign_) minalign_ = AlignOf<T>();
 		PushBytes(reinterpret_cast<const uint8_t *>(v), sizeof(T) * len);
 		return Offset<Vector<const T *>>(EndVector(len));
 	}
 
 	template<typename T> 
 	Offset<Vector<const T *>> CreateVectorOfStructs(const std::vector<T> &v) {
-		return CreateVector(&v[0], v.size());
+		return CreateVectorOfStructs(v.data(), v.size());
 	}
 	template<typename T> 
 	void Finish(Offset<T> root) {
+		NotNested();
 		PreAlign(sizeof(uofs_t), minalign_);
 		PushElement(ReferTo(root.o));
 	}
+
+	// Finish with the size of the message in front of it, so messages can be
+	// concatenated into a stream. The size doesn't count the prefix itself.
+	template<typename T> 
+	void FinishSizePrefixed(Offset<T> root) {
+		NotNested();
+		PreAlign(sizeof(uofs_t) * 2, minalign_);
+		PushElement(ReferTo(root.o));
+		PushElement(static_cast<uofs_t>(GetSize()));
+	}
 };
 
 } // namespace megrez
@@ -0,0 +1,136 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_ENDIAN_H_
+#define MEGREZ_ENDIAN_H_
+
+#include <cstring>
+#include <type_traits>
+#include "megrez/basic.h"
+
+#if !MEGREZ_LITTLEENDIAN
+	#if defined(__SSSE3__)
+		#include <tmmintrin.h>
+	#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		#include <arm_neon.h>
+	#endif
+#endif
+
+namespace megrez {
+
+// Bulk copies between a buffer and native memory. Scalars are stored
+// little-endian, so on little-endian hosts these are plain memcpy calls;
+// on big-endian hosts whole arrays are byte swapped 16 bytes at a time
+// with SSSE3 or NEON where available, and by a loop the compiler can
+// vectorize otherwise. `dst` and `src` must not overlap and need no
+// alignment.
+namespace endian {
+
+template<size_t Size>
+struct Swap;
+
+template<>
+struct Swap<1> {
+	static void Copy(uint8_t *dst, const uint8_t *src, size_t n) { memcpy(dst, src, n); }
+};
+
+template<>
+struct Swap<2> {
+	typedef uint16_t type;
+	static type Bytes(type v) { return static_cast<type>((v >> 8) | (v << 8)); }
+};
+
+template<>
+struct Swap<4> {
+	typedef uint32_t type;
+	static type Bytes(type v) {
+		return (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+	}
+};
+
+template<>
+struct Swap<8> {
+	typedef uint64_t type;
+	static type Bytes(type v) {
+		return (static_cast<uint64_t>(Swap<4>::Bytes(static_cast<uint32_t>(v))) << 32) |
+			Swap<4>::Bytes(static_cast<uint32_t>(v >> 32));
+	}
+};
+
+// The elements from `i` on, one at a time.
+template<size_t Size>
+void SwapTail(uint8_t *dst, const uint8_t *src, size_t i, size_t n) {
+	typedef typename Swap<Size>::type U;
+	for (; i < n; i++) {
+		U v;
+		memcpy(&v, src + i * Size, Size);
+		v = Swap<Size>::Bytes(v);
+		memcpy(dst + i * Size, &v, Size);
+	}
+}
+
+template<size_t Size>
+void SwapCopy(uint8_t *dst, const uint8_t *src, size_t n) {
+	size_t i = 0;
+	#if defined(__SSSE3__)
+		// Reverse the bytes of each Size wide lane of a 16 byte register.
+		const int s = static_cast<int>(Size);
+		alignas(16) int8_t order[16];
+		for (int b = 0; b < 16; b++) order[b] = static_cast<int8_t>(b - b % s + s - 1 - b % s);
+		const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(order));
+		const size_t per = 16 / Size;
+		for (; i + per <= n; i += per) {
+			auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * Size));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * Size),
+							 _mm_shuffle_epi8(v, shuffle));
+		}
+	#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+		const size_t per = 16 / Size;
+		for (; i + per <= n; i += per) {
+			auto v = vld1q_u8(src + i * Size);
+			v = Size == 2 ? vrev16q_u8(v) : Size == 4 ? vrev32q_u8(v) : vrev64q_u8(v);
+			vst1q_u8(dst + i * Size, v);
+		}
+	#endif
+	SwapTail<Size>(dst, src, i, n);
+}
+
+template<>
+inline void SwapCopy<1>(uint8_t *dst, const uint8_t *src, size_t n) {
+	Swap<1>::Copy(dst, src, n);
+}
+
+}  // namespace endian
+
+// Copy `n` elements of type T, converting scalars, enums included, between
+// buffer and host byte order. Structs keep their fields little-endian in
+// native memory too, so they are copied as they are.
+template<typename T>
+void EndianCopy(void *dst, const void *src, size_t n) {
+	if (!n) return;  // empty std::vectors may hand in nullptr
+	#if MEGREZ_LITTLEENDIAN
+		memcpy(dst, src, n * sizeof(T));
+	#else
+		const bool swap = std::is_arithmetic<T>::value || std::is_enum<T>::value;
+		endian::SwapCopy<swap ? sizeof(T) : 1>(static_cast<uint8_t *>(dst),
+											   static_cast<const uint8_t *>(src),
+											   swap ? n : n * sizeof(T));
+	#endif
+}
+
+} // namespace megrez
+
+#endif // MEGREZ_ENDIAN_H_
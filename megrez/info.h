@@ -17,7 +17,9 @@ limitations under the License.
 #ifndef MEGREZ_INFO_H_
 #define MEGREZ_INFO_H_
 
+#include <type_traits>
 #include "megrez/basic.h"
+#include "megrez/verifier.h"
 
 namespace megrez {
 
@@ -28,43 +30,80 @@ class Info {
  public:
 	Info() {};
 	Info(const Info &other) {};
+
+	// Every accessor takes the ReadPolicy of basic.h; generated code passes
+	// UnalignedReads when MegrezC was given --unaligned-reads.
+	template<typename ReadPolicy = AlignedReads> 
 	vofs_t GetOptionalFieldOffset(vofs_t field) const {
-		auto vinfo = &data_ - ReadScalar<sofs_t>(&data_);
-		auto vtsize = ReadScalar<vofs_t>(vinfo);
-		return field < vtsize ? ReadScalar<vofs_t>(vinfo + field) : 0;
+		auto vinfo = &data_ - ReadScalar<sofs_t, ReadPolicy>(&data_);
+		auto vtsize = ReadScalar<vofs_t, ReadPolicy>(vinfo);
+		return field < vtsize ? ReadScalar<vofs_t, ReadPolicy>(vinfo + field) : 0;
 	}
 
-	template<typename T> 
+	template<typename T, typename ReadPolicy = AlignedReads> 
 	T GetField(vofs_t field, T defaultval) const {
-		auto field_offset = GetOptionalFieldOffset(field);
-		return field_offset ? ReadScalar<T>(&data_[field_offset]) : defaultval;
+		auto field_offset = GetOptionalFieldOffset<ReadPolicy>(field);
+		return field_offset ? ReadScalar<T, ReadPolicy>(&data_[field_offset]) : defaultval;
 	}
 
-	template<typename P> 
+	template<typename P, typename ReadPolicy = AlignedReads> 
 	P GetPointer(vofs_t field) const {
-		auto field_offset = GetOptionalFieldOffset(field);
+		auto field_offset = GetOptionalFieldOffset<ReadPolicy>(field);
 		auto p = &data_[field_offset];
 		return field_offset
-			? reinterpret_cast<P>(p + ReadScalar<uofs_t>(p))
+			? reinterpret_cast<P>(p + ReadScalar<uofs_t, ReadPolicy>(p))
 			: nullptr;
 	}
 
-	template<typename P> 
+	template<typename P, typename ReadPolicy = AlignedReads> 
 	P GetStruct(vofs_t field) const {
-		auto field_offset = GetOptionalFieldOffset(field);
+		auto field_offset = GetOptionalFieldOffset<ReadPolicy>(field);
 		return field_offset ? reinterpret_cast<P>(&data_[field_offset]) : nullptr;
 	}
 
-	template<typename T> 
-	void SetField(vofs_t field, T val) {
-		auto field_offset = GetOptionalFieldOffset(field);
-		assert(field_offset);
-		WriteScalar(&data_[field_offset], val);
+	// Only fields present in the buffer can be changed: a field left at its
+	// default has no storage, and SetField returns false.
+	template<typename T, typename ReadPolicy = AlignedReads> 
+	bool SetField(vofs_t field, T val) {
+		auto field_offset = GetOptionalFieldOffset<ReadPolicy>(field);
+		if (!field_offset) return false;
+		WriteScalar<T, ReadPolicy>(&data_[field_offset], val);
+		return true;
+	}
+
+	template<typename P, typename ReadPolicy = AlignedReads> 
+	P GetMutablePointer(vofs_t field) {
+		typedef const typename std::remove_pointer<P>::type *const_pointer;
+		return const_cast<P>(GetPointer<const_pointer, ReadPolicy>(field));
+	}
+
+	template<typename P, typename ReadPolicy = AlignedReads> 
+	P GetMutableStruct(vofs_t field) {
+		typedef const typename std::remove_pointer<P>::type *const_pointer;
+		return const_cast<P>(GetStruct<const_pointer, ReadPolicy>(field));
 	}
 
 	bool CheckField(vofs_t field) const {
 		return GetOptionalFieldOffset(field) != 0;
 	}
+
+	// Used by the generated Verify() functions before any field: checks the
+	// vtable that the field checks below read.
+	bool VerifyInfoStart(Verifier &verifier) const {
+		return verifier.VerifyInfoStart(data_);
+	}
+
+	template<typename T> 
+	bool VerifyField(const Verifier &verifier, vofs_t field) const {
+		auto field_offset = GetOptionalFieldOffset<UnalignedReads>(field);
+		return !field_offset || verifier.Verify<T>(data_ + field_offset);
+	}
+
+	// Checks the offset stored in a field, not what it refers to.
+	bool VerifyOffset(const Verifier &verifier, vofs_t field) const {
+		auto field_offset = GetOptionalFieldOffset<UnalignedReads>(field);
+		return !field_offset || verifier.VerifyOffset(data_ + field_offset);
+	}
 };
 
 } // namespace megrez
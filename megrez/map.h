@@ -0,0 +1,121 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_MAP_H_
+#define MEGREZ_MAP_H_
+
+#include <type_traits>
+#include "megrez/basic.h"
+#include "megrez/string.h"
+#include "megrez/util.h"
+#include "megrez/vector.h"
+
+namespace megrez {
+
+// Hashing and comparison of map keys. The hash is part of the format: it is
+// FNV-1a over the little-endian bytes of an integer key, or over the bytes
+// of a string key.
+template<typename K> 
+struct MapKey {
+	static_assert(std::is_integral<K>::value, "map keys must be integers or strings");
+	typedef K lookup_type;
+	static uint32_t Hash(K key) {
+		auto le = EndianScalar(key);
+		return HashBytes(reinterpret_cast<const uint8_t *>(&le), sizeof(K));
+	}
+	static bool Equal(K stored, K key) { return stored == key; }
+};
+
+template<> 
+struct MapKey<Offset<String>> {
+	typedef StringRef lookup_type;
+	static uint32_t Hash(StringRef key) {
+		return HashBytes(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+	}
+	template<typename S> 
+	static bool Equal(const S *stored, StringRef key) { return stored->view() == key; }
+};
+
+// Number of slots for a map of `len` entries: a power of two, at most half
+// full, so probe sequences stay short.
+inline size_t MapCapacity(size_t len) {
+	size_t capacity = len ? 2 : 0;
+	while (capacity < len * 2) capacity *= 2;
+	return capacity;
+}
+
+// An open addressing hash table inside a buffer: three offsets, to the
+// slots, the keys and the values. Keys and values are ordinary vectors with
+// matching indices. A slot holds the index of an entry plus one, or zero
+// when empty, and lookups probe linearly from the slot the hash picks.
+template<typename K, typename V, typename ReadPolicy = AlignedReads> 
+class Map {
+ private:
+	uint8_t data_[1];
+
+	template<typename T> 
+	const T *Follow(size_t i) const {
+		auto p = data_ + i * sizeof(uofs_t);
+		return reinterpret_cast<const T *>(p + ReadScalar<uofs_t, ReadPolicy>(p));
+	}
+
+ public:
+	typedef MapKey<K> key_helper;
+	typedef typename key_helper::lookup_type lookup_type;
+	typedef typename Vector<V, ReadPolicy>::return_type return_type;
+	typedef typename std::remove_cv<
+		typename std::remove_reference<return_type>::type>::type value_type;
+	static const uofs_t npos = static_cast<uofs_t>(~static_cast<uofs_t>(0));
+
+	const Vector<uofs_t, ReadPolicy> *slots() const { return Follow<Vector<uofs_t, ReadPolicy>>(0); }
+	const Vector<K, ReadPolicy> *keys() const { return Follow<Vector<K, ReadPolicy>>(1); }
+	const Vector<V, ReadPolicy> *values() const { return Follow<Vector<V, ReadPolicy>>(2); }
+	uofs_t size() const { return keys()->Length(); }
+
+	// Index of `key` in keys() and values(), or npos.
+	uofs_t IndexOf(lookup_type key) const {
+		auto s = slots();
+		auto capacity = s->Length();
+		if (!capacity) return npos;
+		auto k = keys();
+		auto mask = capacity - 1;
+		auto i = static_cast<uofs_t>(key_helper::Hash(key) & mask);
+		for (uofs_t probes = 0; probes < capacity; probes++, i = (i + 1) & mask) {
+			auto entry = s->Get(i);
+			if (!entry) break;
+			if (key_helper::Equal(k->Get(entry - 1), key)) return entry - 1;
+		}
+		return npos;
+	}
+
+	bool Contains(lookup_type key) const { return IndexOf(key) != npos; }
+
+	bool Find(lookup_type key, value_type *value) const {
+		auto i = IndexOf(key);
+		if (i == npos) return false;
+		*value = values()->Get(i);
+		return true;
+	}
+};
+
+template<typename K, typename V, typename Q, typename ReadPolicy> 
+struct WithReadPolicy<Map<K, V, Q>, ReadPolicy> {
+	typedef Map<K, V, ReadPolicy> type;
+};
+
+} // namespace megrez
+
+#endif // MEGREZ_MAP_H_
@@ -0,0 +1,177 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_MAPPED_H_
+#define MEGREZ_MAPPED_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include "megrez/basic.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define MEGREZ_HAS_MMAP 1
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#else
+	#define MEGREZ_HAS_MMAP 0
+#endif
+
+namespace megrez {
+
+// A file opened read-only and mapped into memory, so a buffer stored in it
+// can be handed to GetRoot or a Verifier without being copied:
+//
+//   MappedFile file("snapshot.bin", MappedFile::kRandom);
+//   Verifier verifier(file.data(), file.size());
+//   if (VerifyPersonBuffer(verifier)) { auto person = GetPerson(file.data()); }
+//
+// The data is page aligned. Without mmap, and for files that can't be
+// mapped such as pipes, devices or those in /proc, the file is read into
+// an aligned heap block instead.
+class MappedFile {
+ public:
+	// How the pages are going to be accessed, passed on to madvise.
+	enum Advice {
+		kNormal,
+		kSequential,  // read ahead aggressively, drop pages once read
+		kRandom,      // no read ahead, e.g. for lookups into a large file
+		kWillNeed     // start reading the whole file in now
+	};
+
+	MappedFile() : data_(nullptr), size_(0), mapped_(false) {}
+	explicit MappedFile(const char *name, Advice advice = kNormal, bool huge_pages = false)
+		: data_(nullptr), size_(0), mapped_(false) {
+		Open(name, advice, huge_pages);
+	}
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile &&other)
+		: data_(other.data_), size_(other.size_), mapped_(other.mapped_) {
+		other.data_ = nullptr;
+		other.size_ = 0;
+		other.mapped_ = false;
+	}
+	MappedFile &operator=(MappedFile &&other) {
+		if (this != &other) {
+			Close();
+			data_ = other.data_;
+			size_ = other.size_;
+			mapped_ = other.mapped_;
+			other.data_ = nullptr;
+			other.size_ = 0;
+			other.mapped_ = false;
+		}
+		return *this;
+	}
+	~MappedFile() { Close(); }
+
+	// Returns false if the file can't be opened or read. `huge_pages` asks
+	// for transparent huge pages where the kernel supports them for files.
+	bool Open(const char *name, Advice advice = kNormal, bool huge_pages = false) {
+		Close();
+		#if MEGREZ_HAS_MMAP
+			auto fd = open(name, O_RDONLY);
+			if (fd < 0) return false;
+			struct stat st;
+			if (fstat(fd, &st) != 0) { close(fd); return false; }
+			// Only regular files have their size up front; the others report
+			// zero, or a size that isn't what reading them gives.
+			if (!S_ISREG(st.st_mode) || !st.st_size) {
+				auto f = fdopen(fd, "rb");
+				if (!f) { close(fd); return false; }
+				return Read(f);
+			}
+			size_ = static_cast<size_t>(st.st_size);
+			auto p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) { close(fd); size_ = 0; return false; }
+			data_ = static_cast<uint8_t *>(p);
+			mapped_ = true;
+			close(fd);  // the mapping keeps the file alive
+			Advise(advice);
+			#ifdef MADV_HUGEPAGE
+				if (huge_pages) madvise(data_, size_, MADV_HUGEPAGE);
+			#else
+				(void)huge_pages;
+			#endif
+			return true;
+		#else
+			(void)advice;
+			(void)huge_pages;
+			auto f = fopen(name, "rb");
+			return f && Read(f);
+		#endif
+	}
+
+	// Change the access hint of an open file.
+	void Advise(Advice advice) {
+		#if MEGREZ_HAS_MMAP
+			if (!mapped_) return;
+			int hints[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+			madvise(data_, size_, hints[advice]);
+		#else
+			(void)advice;
+		#endif
+	}
+
+	void Close() {
+		#if MEGREZ_HAS_MMAP
+			if (mapped_) munmap(data_, size_);
+		#endif
+		if (!mapped_) free(data_);
+		data_ = nullptr;
+		size_ = 0;
+		mapped_ = false;
+	}
+
+	const uint8_t *data() const { return data_; }
+	size_t size() const { return size_; }
+	// False when the file had to be read into memory instead.
+	bool mapped() const { return mapped_; }
+
+ private:
+	uint8_t *data_;
+	size_t size_;
+	bool mapped_;
+
+	// Reads `f` to its end into a malloc'd block, which is aligned for any
+	// scalar, and closes it. The size isn't asked for, so this also works
+	// for streams that can't seek.
+	bool Read(FILE *f) {
+		size_t capacity = 0;
+		for (;;) {
+			if (size_ == capacity) {
+				capacity = capacity ? capacity * 2 : 64 * 1024;
+				auto p = static_cast<uint8_t *>(realloc(data_, capacity));
+				if (!p) break;
+				data_ = p;
+			}
+			auto wanted = capacity - size_;
+			auto n = fread(data_ + size_, 1, wanted, f);
+			size_ += n;
+			if (n < wanted) break;  // the end of the file, or an error
+		}
+		bool ok = size_ < capacity && !ferror(f);
+		fclose(f);
+		if (!ok) Close();
+		return ok;
+	}
+};
+
+} // namespace megrez
+
+#endif // MEGREZ_MAPPED_H_
@@ -0,0 +1,166 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_OBJECT_H_
+#define MEGREZ_OBJECT_H_
+
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include "megrez/allocator.h"
+#include "megrez/basic.h"
+#include "megrez/map.h"
+
+namespace megrez {
+
+// Standard library allocator drawing from a megrez::Allocator, so the
+// objects unpacked from one message can all come from a single arena.
+// nullptr stands for the heap.
+template<typename T>
+class StlAllocator {
+ public:
+	typedef T value_type;
+
+	StlAllocator(Allocator *allocator = nullptr)
+		: allocator_(allocator ? allocator : &DefaultAllocator::instance()) {}
+	template<typename U>
+	StlAllocator(const StlAllocator<U> &other) : allocator_(other.allocator()) {}
+
+	T *allocate(size_t n) {
+		return reinterpret_cast<T *>(allocator_->allocate(n * sizeof(T)));
+	}
+	void deallocate(T *p, size_t n) {
+		allocator_->deallocate(reinterpret_cast<uint8_t *>(p), n * sizeof(T));
+	}
+
+	Allocator *allocator() const { return allocator_; }
+
+ private:
+	Allocator *allocator_;
+};
+
+template<typename T, typename U>
+bool operator==(const StlAllocator<T> &a, const StlAllocator<U> &b) {
+	return a.allocator() == b.allocator();
+}
+template<typename T, typename U>
+bool operator!=(const StlAllocator<T> &a, const StlAllocator<U> &b) {
+	return a.allocator() != b.allocator();
+}
+
+// Member types of the generated <Type>T objects.
+typedef std::basic_string<char, std::char_traits<char>, StlAllocator<char>> ObjString;
+template<typename T>
+using ObjVector = std::vector<T, StlAllocator<T>>;
+
+template<typename T>
+struct ObjDeleter {
+	Allocator *allocator;
+	ObjDeleter(Allocator *a = nullptr) : allocator(a) {}
+	void operator()(T *p) const {
+		p->~T();
+		allocator->deallocate(reinterpret_cast<uint8_t *>(p), sizeof(T));
+	}
+};
+
+template<typename T>
+using ObjPtr = std::unique_ptr<T, ObjDeleter<T>>;
+
+// Map members: the entries in any order, with unique keys as for
+// MegrezBuilder::CreateMap.
+template<typename K, typename V>
+using ObjMap = ObjVector<std::pair<K, V>>;
+
+template<typename T, typename... Args>
+ObjPtr<T> MakeObj(Allocator *allocator, Args &&... args) {
+	if (!allocator) allocator = &DefaultAllocator::instance();
+	auto p = new (allocator->allocate(sizeof(T))) T(std::forward<Args>(args)...);
+	return ObjPtr<T>(p, ObjDeleter<T>(allocator));
+}
+
+// Union members: the type tag of the union and the object it stands for,
+// owned like an ObjPtr. Set them together, the tag being that of the
+// object's type; NONE (0) goes with no object.
+class ObjUnion {
+ public:
+	uint8_t type;
+
+	ObjUnion() : type(0), value_(nullptr), allocator_(nullptr), destroy_(nullptr) {}
+	ObjUnion(ObjUnion &&other) : ObjUnion() { Swap(other); }
+	ObjUnion &operator=(ObjUnion &&other) {
+		Swap(other);
+		return *this;
+	}
+	~ObjUnion() { Reset(); }
+
+	template<typename T>
+	void Set(uint8_t tag, ObjPtr<T> obj) {
+		Reset();
+		if (!obj) return;
+		type = tag;
+		allocator_ = obj.get_deleter().allocator;
+		value_ = obj.release();
+		destroy_ = &Destroy<T>;
+	}
+
+	void Reset() {
+		if (value_) destroy_(value_, allocator_);
+		type = 0;
+		value_ = nullptr;
+	}
+
+	void *get() const { return value_; }
+	// The object, which has to be of the type the tag stands for.
+	template<typename T>
+	T *As() const { return static_cast<T *>(value_); }
+
+ private:
+	void *value_;
+	Allocator *allocator_;
+	void (*destroy_)(void *, Allocator *);
+
+	template<typename T>
+	static void Destroy(void *p, Allocator *allocator) {
+		ObjDeleter<T> deleter(allocator);
+		deleter(static_cast<T *>(p));
+	}
+
+	void Swap(ObjUnion &other) {
+		std::swap(type, other.type);
+		std::swap(value_, other.value_);
+		std::swap(allocator_, other.allocator_);
+		std::swap(destroy_, other.destroy_);
+	}
+};
+
+// Upper bounds of the bytes Pack writes, used to size the builder once.
+inline size_t PackedVectorSize(size_t len, size_t elemsize) {
+	return len * elemsize + 2 * sizeof(uofs_t) + sizeof(max_scalar_t);
+}
+
+inline size_t PackedStringSize(size_t len) { return PackedVectorSize(len + 1, 1); }
+
+// The slots, keys and values vectors of a map and its three offsets.
+inline size_t PackedMapSize(size_t len, size_t keysize, size_t valuesize) {
+	return PackedVectorSize(MapCapacity(len), sizeof(uofs_t)) + PackedVectorSize(len, keysize) +
+		PackedVectorSize(len, valuesize) + 3 * sizeof(uofs_t) + sizeof(max_scalar_t);
+}
+
+} // namespace megrez
+
+#endif // MEGREZ_OBJECT_H_
@@ -0,0 +1,318 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_REFLECTION_H_
+#define MEGREZ_REFLECTION_H_
+
+#include <cassert>
+#include "megrez/basic.h"
+#include "megrez/info.h"
+#include "megrez/map.h"
+#include "megrez/reflection.mgz.h"
+#include "megrez/string.h"
+#include "megrez/struct.h"
+#include "megrez/util.h"
+#include "megrez/vector.h"
+
+namespace megrez {
+
+// Reading buffers of any type in place, with the binary schema MegrezC -b
+// wrote for them instead of generated code:
+//
+//   auto schema = reflection::GetSchema(mbs);
+//   auto person = FindObject(*schema, "Person");
+//   auto age = FindField(*person, "age");
+//   auto root = GetAnyRoot(buf);
+//   int64_t years = GetAnyFieldI(*root, *age);
+//
+// Lookups by name are binary searches; look fields up once and keep the
+// pointers for reading many buffers. The buffers aren't verified here:
+// check buffers from elsewhere with the generated Verify<Main>Buffer, or
+// trust their source. Base types are the reflection::BaseType_ values.
+
+// Inline size of a value: structs take Object::bytesize() instead.
+inline size_t GetTypeSize(int base_type) {
+	static const uint8_t sizes[] = {
+		1, 1, 1, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8,
+		sizeof(uofs_t), sizeof(uofs_t), sizeof(uofs_t), sizeof(uofs_t), sizeof(uofs_t)
+	};
+	return sizes[base_type];
+}
+
+inline bool IsAnyInteger(int base_type) {
+	return base_type >= reflection::BaseType_UType && base_type <= reflection::BaseType_ULong;
+}
+
+inline bool IsAnyFloat(int base_type) {
+	return base_type == reflection::BaseType_Float || base_type == reflection::BaseType_Double;
+}
+
+template<typename ReadPolicy = AlignedReads>
+const Info *GetAnyRoot(const void *buf) { return GetRoot<Info, ReadPolicy>(buf); }
+
+inline const reflection::Object *FindObject(const reflection::Schema &schema, StringRef name) {
+	return schema.objects() ? schema.objects()->LookupByKey(name) : nullptr;
+}
+
+inline const reflection::Enum *FindEnum(const reflection::Schema &schema, StringRef name) {
+	return schema.enums() ? schema.enums()->LookupByKey(name) : nullptr;
+}
+
+inline const reflection::Field *FindField(const reflection::Object &object, StringRef name) {
+	return object.fields() ? object.fields()->LookupByKey(name) : nullptr;
+}
+
+// The field declared at position `id`. Object::fields() are ordered by name.
+inline const reflection::Field *GetFieldById(const reflection::Object &object, int id) {
+	if (!object.fields()) return nullptr;
+	for (auto it = object.fields()->begin(); it != object.fields()->end(); ++it)
+		if ((*it)->id() == id) return *it;
+	return nullptr;
+}
+
+// The struct, info or enum a Type::index() refers to.
+inline const reflection::Object *GetObject(const reflection::Schema &schema, int index) {
+	auto objects = schema.objects();
+	return objects && index >= 0 && static_cast<uofs_t>(index) < objects->size()
+		? objects->Get(index) : nullptr;
+}
+
+inline const reflection::Enum *GetEnum(const reflection::Schema &schema, int index) {
+	auto enums = schema.enums();
+	return enums && index >= 0 && static_cast<uofs_t>(index) < enums->size()
+		? enums->Get(index) : nullptr;
+}
+
+inline const reflection::Object *GetMainObject(const reflection::Schema &schema) {
+	return GetObject(schema, schema.main_type());
+}
+
+// A scalar of any base type at `data`, converted.
+template<typename ReadPolicy = AlignedReads>
+int64_t GetAnyValueI(int base_type, const uint8_t *data) {
+	switch (base_type) {
+		case reflection::BaseType_UType:
+		case reflection::BaseType_Bool:
+		case reflection::BaseType_UByte:  return ReadScalar<uint8_t, ReadPolicy>(data);
+		case reflection::BaseType_Byte:   return ReadScalar<int8_t, ReadPolicy>(data);
+		case reflection::BaseType_Short:  return ReadScalar<int16_t, ReadPolicy>(data);
+		case reflection::BaseType_UShort: return ReadScalar<uint16_t, ReadPolicy>(data);
+		case reflection::BaseType_Int:    return ReadScalar<int32_t, ReadPolicy>(data);
+		case reflection::BaseType_UInt:   return ReadScalar<uint32_t, ReadPolicy>(data);
+		case reflection::BaseType_Long:   return ReadScalar<int64_t, ReadPolicy>(data);
+		case reflection::BaseType_ULong:
+			return static_cast<int64_t>(ReadScalar<uint64_t, ReadPolicy>(data));
+		case reflection::BaseType_Float:
+			return static_cast<int64_t>(ReadScalar<float, ReadPolicy>(data));
+		case reflection::BaseType_Double:
+			return static_cast<int64_t>(ReadScalar<double, ReadPolicy>(data));
+		default: return 0;
+	}
+}
+
+template<typename ReadPolicy = AlignedReads>
+double GetAnyValueF(int base_type, const uint8_t *data) {
+	switch (base_type) {
+		case reflection::BaseType_Float:  return ReadScalar<float, ReadPolicy>(data);
+		case reflection::BaseType_Double: return ReadScalar<double, ReadPolicy>(data);
+		case reflection::BaseType_ULong:
+			return static_cast<double>(ReadScalar<uint64_t, ReadPolicy>(data));
+		default: return static_cast<double>(GetAnyValueI<ReadPolicy>(base_type, data));
+	}
+}
+
+// Where a field of an info is stored, or nullptr if it was left at its
+// default or holds nothing.
+template<typename ReadPolicy = AlignedReads>
+const uint8_t *GetFieldAddress(const Info &info, const reflection::Field &field) {
+	auto field_offset = info.GetOptionalFieldOffset<ReadPolicy>(field.offset());
+	return field_offset ? reinterpret_cast<const uint8_t *>(&info) + field_offset : nullptr;
+}
+
+// Scalar fields of any type, converted. Fields that aren't set read as
+// their default.
+template<typename ReadPolicy = AlignedReads>
+int64_t GetAnyFieldI(const Info &info, const reflection::Field &field) {
+	auto base_type = field.type()->base_type();
+	auto data = GetFieldAddress<ReadPolicy>(info, field);
+	if (data) return GetAnyValueI<ReadPolicy>(base_type, data);
+	return IsAnyFloat(base_type) ? static_cast<int64_t>(field.default_real())
+								 : field.default_integer();
+}
+
+template<typename ReadPolicy = AlignedReads>
+double GetAnyFieldF(const Info &info, const reflection::Field &field) {
+	auto base_type = field.type()->base_type();
+	auto data = GetFieldAddress<ReadPolicy>(info, field);
+	if (data) return GetAnyValueF<ReadPolicy>(base_type, data);
+	return IsAnyFloat(base_type) ? field.default_real()
+								 : static_cast<double>(field.default_integer());
+}
+
+template<typename ReadPolicy = AlignedReads>
+int64_t GetAnyFieldI(const Struct &st, const reflection::Field &field) {
+	return GetAnyValueI<ReadPolicy>(field.type()->base_type(),
+									reinterpret_cast<const uint8_t *>(&st) + field.offset());
+}
+
+template<typename ReadPolicy = AlignedReads>
+double GetAnyFieldF(const Struct &st, const reflection::Field &field) {
+	return GetAnyValueF<ReadPolicy>(field.type()->base_type(),
+									reinterpret_cast<const uint8_t *>(&st) + field.offset());
+}
+
+// Fields of a type known to the caller, read like generated accessors do.
+template<typename T, typename ReadPolicy = AlignedReads>
+T GetFieldI(const Info &info, const reflection::Field &field) {
+	assert(sizeof(T) == GetTypeSize(field.type()->base_type()));
+	return info.GetField<T, ReadPolicy>(field.offset(), static_cast<T>(field.default_integer()));
+}
+
+template<typename T, typename ReadPolicy = AlignedReads>
+T GetFieldF(const Info &info, const reflection::Field &field) {
+	assert(sizeof(T) == GetTypeSize(field.type()->base_type()));
+	return info.GetField<T, ReadPolicy>(field.offset(), static_cast<T>(field.default_real()));
+}
+
+template<typename ReadPolicy = AlignedReads>
+const typename WithReadPolicy<String, ReadPolicy>::type *GetFieldS(const Info &info,
+																	const reflection::Field &field) {
+	assert(field.type()->base_type() == reflection::BaseType_String);
+	return info.GetPointer<const typename WithReadPolicy<String, ReadPolicy>::type *, ReadPolicy>(
+		field.offset());
+}
+
+template<typename T, typename ReadPolicy = AlignedReads>
+const Vector<T, ReadPolicy> *GetFieldV(const Info &info, const reflection::Field &field) {
+	assert(field.type()->base_type() == reflection::BaseType_Vector);
+	return info.GetPointer<const Vector<T, ReadPolicy> *, ReadPolicy>(field.offset());
+}
+
+// Info and union fields.
+template<typename ReadPolicy = AlignedReads>
+const Info *GetFieldInfo(const Info &info, const reflection::Field &field) {
+	assert(field.type()->base_type() == reflection::BaseType_Obj ||
+		   field.type()->base_type() == reflection::BaseType_Union);
+	return info.GetPointer<const Info *, ReadPolicy>(field.offset());
+}
+
+template<typename ReadPolicy = AlignedReads>
+const Struct *GetFieldStruct(const Info &info, const reflection::Field &field) {
+	assert(field.type()->base_type() == reflection::BaseType_Obj);
+	return info.GetStruct<const Struct *, ReadPolicy>(field.offset());
+}
+
+// The info a union field of `object` holds, as given by the union type
+// field declared right before it, or nullptr for none.
+template<typename ReadPolicy = AlignedReads>
+const reflection::Object *GetUnionObject(const reflection::Schema &schema,
+										 const reflection::Object &object,
+										 const reflection::Field &field, const Info &info) {
+	auto type_field = GetFieldById(object, field.id() - 1);
+	auto union_def = GetEnum(schema, field.type()->index());
+	if (!type_field || !union_def || !union_def->values()) return nullptr;
+	auto value = union_def->values()->LookupByKey(GetAnyFieldI<ReadPolicy>(info, *type_field));
+	return value ? GetObject(schema, value->object()) : nullptr;
+}
+
+// Elements of vectors of any type. Scalars are converted, offsets to
+// strings and infos followed, and structs of `size` bytes returned in place.
+template<typename ReadPolicy = AlignedReads>
+int64_t GetAnyVectorElemI(const Vector<uint8_t, ReadPolicy> &vec, int elem_type, uofs_t i) {
+	assert(i < vec.size());
+	return GetAnyValueI<ReadPolicy>(elem_type, vec.data() + i * GetTypeSize(elem_type));
+}
+
+template<typename ReadPolicy = AlignedReads>
+double GetAnyVectorElemF(const Vector<uint8_t, ReadPolicy> &vec, int elem_type, uofs_t i) {
+	assert(i < vec.size());
+	return GetAnyValueF<ReadPolicy>(elem_type, vec.data() + i * GetTypeSize(elem_type));
+}
+
+template<typename T, typename ReadPolicy = AlignedReads>
+const T *GetAnyVectorElemPointer(const Vector<uint8_t, ReadPolicy> &vec, uofs_t i) {
+	assert(i < vec.size());
+	auto p = vec.data() + i * sizeof(uofs_t);
+	return reinterpret_cast<const T *>(p + ReadScalar<uofs_t, ReadPolicy>(p));
+}
+
+template<typename ReadPolicy = AlignedReads>
+const Struct *GetAnyVectorElemStruct(const Vector<uint8_t, ReadPolicy> &vec, size_t size,
+									 uofs_t i) {
+	assert(i < vec.size());
+	return reinterpret_cast<const Struct *>(vec.data() + i * size);
+}
+
+// Map fields of key and value types known to the caller.
+template<typename K, typename V, typename ReadPolicy = AlignedReads>
+const Map<K, V, ReadPolicy> *GetFieldMap(const Info &info, const reflection::Field &field) {
+	assert(field.type()->base_type() == reflection::BaseType_Map);
+	return info.GetPointer<const Map<K, V, ReadPolicy> *, ReadPolicy>(field.offset());
+}
+
+// The keys and values of a map field of any type, at matching indices, for
+// GetAnyVectorElem*() with Type::key() and Type::element(). nullptr if the
+// map isn't set.
+template<typename ReadPolicy = AlignedReads>
+const Vector<uint8_t, ReadPolicy> *GetAnyMapKeys(const Info &info, const reflection::Field &field) {
+	auto map = GetFieldMap<uint8_t, uint8_t, ReadPolicy>(info, field);
+	return map ? map->keys() : nullptr;
+}
+
+template<typename ReadPolicy = AlignedReads>
+const Vector<uint8_t, ReadPolicy> *GetAnyMapValues(const Info &info,
+													const reflection::Field &field) {
+	auto map = GetFieldMap<uint8_t, uint8_t, ReadPolicy>(info, field);
+	return map ? map->values() : nullptr;
+}
+
+template<typename K, typename ReadPolicy>
+uofs_t GetAnyMapIndex(const Info &info, const reflection::Field &field, int64_t key) {
+	auto map = GetFieldMap<K, uint8_t, ReadPolicy>(info, field);
+	if (!map || static_cast<int64_t>(static_cast<K>(key)) != key) return Map<K, uint8_t>::npos;
+	return map->IndexOf(static_cast<K>(key));
+}
+
+// Index of a key in a map field of any type, for GetAnyMapValues(), or
+// Map::npos if it isn't there. Keys hash by their declared type, so integer
+// keys are converted to it first.
+template<typename ReadPolicy = AlignedReads>
+uofs_t GetAnyMapIndexI(const Info &info, const reflection::Field &field, int64_t key) {
+	switch (field.type()->key()) {
+		case reflection::BaseType_UType:
+		case reflection::BaseType_Bool:
+		case reflection::BaseType_UByte:  return GetAnyMapIndex<uint8_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_Byte:   return GetAnyMapIndex<int8_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_Short:  return GetAnyMapIndex<int16_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_UShort: return GetAnyMapIndex<uint16_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_Int:    return GetAnyMapIndex<int32_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_UInt:   return GetAnyMapIndex<uint32_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_Long:   return GetAnyMapIndex<int64_t, ReadPolicy>(info, field, key);
+		case reflection::BaseType_ULong:  return GetAnyMapIndex<uint64_t, ReadPolicy>(info, field, key);
+		default: return Map<int64_t, uint8_t>::npos;
+	}
+}
+
+template<typename ReadPolicy = AlignedReads>
+uofs_t GetAnyMapIndexS(const Info &info, const reflection::Field &field, StringRef key) {
+	assert(field.type()->key() == reflection::BaseType_String);
+	auto map = GetFieldMap<Offset<String>, uint8_t, ReadPolicy>(info, field);
+	return map ? map->IndexOf(key) : Map<Offset<String>, uint8_t>::npos;
+}
+
+} // namespace megrez
+
+#endif // MEGREZ_REFLECTION_H_
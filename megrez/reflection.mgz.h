@@ -0,0 +1,635 @@
+// Automatically generated by MegrezCompiler, DO NOT MODIFY!
+
+#ifndef MEGREZ_GENERATED_MEGREZ_REFLECTION_REFLECTION_MGZ_H_
+#define MEGREZ_GENERATED_MEGREZ_REFLECTION_REFLECTION_MGZ_H_
+
+#include <megrez/basic.h>
+#include <megrez/builder.h>
+#include <megrez/info.h>
+#include <megrez/map.h>
+#include <megrez/string.h>
+#include <megrez/struct.h>
+#include <megrez/vector.h>
+#include <megrez/verifier.h>
+
+static_assert(MEGREZ_OFFSET_BITS == 32,
+	"generated for 32-bit offsets, define MEGREZ_OFFSET_BITS accordingly");
+
+namespace megrez {
+namespace reflection {
+
+enum {
+	BaseType_None = 0,
+	BaseType_UType = 1,
+	BaseType_Bool = 2,
+	BaseType_Byte = 3,
+	BaseType_UByte = 4,
+	BaseType_Short = 5,
+	BaseType_UShort = 6,
+	BaseType_Int = 7,
+	BaseType_UInt = 8,
+	BaseType_Long = 9,
+	BaseType_ULong = 10,
+	BaseType_Float = 11,
+	BaseType_Double = 12,
+	BaseType_String = 13,
+	BaseType_Vector = 14,
+	BaseType_Obj = 15,
+	BaseType_Union = 16,
+	BaseType_Map = 17,
+};
+
+inline const char **EnumNamesBaseType() {
+	static const char *names[] = { "None", "UType", "Bool", "Byte", "UByte", "Short", "UShort", "Int", "UInt", "Long", "ULong", "Float", "Double", "String", "Vector", "Obj", "Union", "Map", nullptr };
+	return names;
+}
+
+inline const char *EnumNameBaseType(int e) { return EnumNamesBaseType()[e]; }
+
+struct Type;
+struct EnumVal;
+struct Enum;
+struct Field;
+struct Object;
+struct Schema;
+
+struct Type : private megrez::Info {
+	uint8_t base_type() const { return GetField<uint8_t>(4, 0); }
+	uint8_t element() const { return GetField<uint8_t>(6, 0); }
+	uint8_t key() const { return GetField<uint8_t>(8, 0); }
+	int32_t index() const { return GetField<int32_t>(10, -1); }
+	bool Verify(megrez::Verifier &verifier) const {
+		return VerifyInfoStart(verifier) &&
+			VerifyField<uint8_t>(verifier, 4) &&
+			VerifyField<uint8_t>(verifier, 6) &&
+			VerifyField<uint8_t>(verifier, 8) &&
+			VerifyField<int32_t>(verifier, 10) &&
+			verifier.EndInfo();
+	}
+};
+
+struct TypeBuilder {
+	megrez::MegrezBuilder &mb_;
+	megrez::uofs_t start_;
+	void add_base_type(uint8_t base_type) { mb_.AddElement<uint8_t>(4, base_type, 0); }
+	void add_element(uint8_t element) { mb_.AddElement<uint8_t>(6, element, 0); }
+	void add_key(uint8_t key) { mb_.AddElement<uint8_t>(8, key, 0); }
+	void add_index(int32_t index) { mb_.AddElement<int32_t>(10, index, -1); }
+	TypeBuilder(megrez::MegrezBuilder &_mb) : mb_(_mb) { start_ = mb_.StartInfo(); }
+	megrez::Offset<Type> Finish() { return megrez::Offset<Type>(mb_.EndInfo(start_, 4)); }
+	megrez::Offset<Type> FinishShared() { return megrez::Offset<Type>(mb_.EndSharedInfo(start_, 4)); }
+};
+
+inline megrez::Offset<Type> CreateType(
+	  megrez::MegrezBuilder &_mb,
+	  uint8_t base_type,
+	  uint8_t element,
+	  uint8_t key,
+	  int32_t index) {
+
+	TypeBuilder builder_(_mb);
+	builder_.add_index(index);
+	builder_.add_key(key);
+	builder_.add_element(element);
+	builder_.add_base_type(base_type);
+	return builder_.Finish();
+}
+
+// Every field is written, so all offsets have to be set. Use CreateType
+// when some of them are absent.
+inline megrez::Offset<Type> CreateTypeFast(
+	  megrez::MegrezBuilder &_mb,
+	  uint8_t base_type,
+	  uint8_t element,
+	  uint8_t key,
+	  int32_t index) {
+
+	static constexpr megrez::vofs_t vtable[] = { 12, 11, 8, 9, 10, 4 };
+	auto info_ = _mb.ReserveFixedInfo(vtable, 4);
+	_mb.SetFixedField<int32_t>(info_, 4, index);
+	_mb.SetFixedField<uint8_t>(info_, 8, base_type);
+	_mb.SetFixedField<uint8_t>(info_, 9, element);
+	_mb.SetFixedField<uint8_t>(info_, 10, key);
+	return megrez::Offset<Type>(info_);
+}
+
+struct EnumVal : private megrez::Info {
+	const megrez::String *name() const { return GetPointer<const megrez::String *>(4); }
+	int64_t value() const { return GetField<int64_t>(6, 0); }
+	int32_t object() const { return GetField<int32_t>(8, -1); }
+	const megrez::String *documentation() const { return GetPointer<const megrez::String *>(10); }
+	bool KeyCompareLessThan(const EnumVal *o) const { return value() < o->value(); }
+	int KeyCompareWithValue(int64_t val) const {
+		auto key = value();
+		return static_cast<int>(key > val) - static_cast<int>(key < val);
+	}
+	bool Verify(megrez::Verifier &verifier) const {
+		return VerifyInfoStart(verifier) &&
+			VerifyOffset(verifier, 4) && verifier.VerifyString(name()) &&
+			VerifyField<int64_t>(verifier, 6) &&
+			VerifyField<int32_t>(verifier, 8) &&
+			VerifyOffset(verifier, 10) && verifier.VerifyString(documentation()) &&
+			verifier.EndInfo();
+	}
+};
+
+struct EnumValBuilder {
+	megrez::MegrezBuilder &mb_;
+	megrez::uofs_t start_;
+	void add_name(megrez::Offset<megrez::String> name) { mb_.AddOffset(4, name); }
+	void add_name(megrez::StringRef name) { mb_.AddOffset(4, mb_.CreateString(name)); }
+	void add_value(int64_t value) { mb_.AddElement<int64_t>(6, value, 0); }
+	void add_object(int32_t object) { mb_.AddElement<int32_t>(8, object, -1); }
+	void add_documentation(megrez::Offset<megrez::String> documentation) { mb_.AddOffset(10, documentation); }
+	void add_documentation(megrez::StringRef documentation) { mb_.AddOffset(10, mb_.CreateString(documentation)); }
+	EnumValBuilder(megrez::MegrezBuilder &_mb) : mb_(_mb) { start_ = mb_.StartInfo(); }
+	megrez::Offset<EnumVal> Finish() { return megrez::Offset<EnumVal>(mb_.EndInfo(start_, 4)); }
+	megrez::Offset<EnumVal> FinishShared() { return megrez::Offset<EnumVal>(mb_.EndSharedInfo(start_, 4)); }
+};
+
+inline megrez::Offset<EnumVal> CreateEnumVal(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  int64_t value,
+	  int32_t object,
+	  megrez::Offset<megrez::String> documentation) {
+
+	EnumValBuilder builder_(_mb);
+	builder_.add_value(value);
+	builder_.add_documentation(documentation);
+	builder_.add_object(object);
+	builder_.add_name(name);
+	return builder_.Finish();
+}
+
+inline megrez::Offset<EnumVal> CreateEnumVal(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::StringRef name,
+	  int64_t value,
+	  int32_t object,
+	  megrez::StringRef documentation) {
+
+	auto name_ = _mb.CreateString(name);
+	auto documentation_ = _mb.CreateString(documentation);
+	EnumValBuilder builder_(_mb);
+	builder_.add_value(value);
+	builder_.add_documentation(documentation_);
+	builder_.add_object(object);
+	builder_.add_name(name_);
+	return builder_.Finish();
+}
+
+// Every field is written, so all offsets have to be set. Use CreateEnumVal
+// when some of them are absent.
+inline megrez::Offset<EnumVal> CreateEnumValFast(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  int64_t value,
+	  int32_t object,
+	  megrez::Offset<megrez::String> documentation) {
+
+	static constexpr megrez::vofs_t vtable[] = { 12, 28, 16, 8, 20, 24 };
+	auto info_ = _mb.ReserveFixedInfo(vtable, 8);
+	_mb.SetFixedField<int64_t>(info_, 8, value);
+	_mb.SetFixedOffset(info_, 16, name);
+	_mb.SetFixedField<int32_t>(info_, 20, object);
+	_mb.SetFixedOffset(info_, 24, documentation);
+	return megrez::Offset<EnumVal>(info_);
+}
+
+struct Enum : private megrez::Info {
+	const megrez::String *name() const { return GetPointer<const megrez::String *>(4); }
+	const megrez::Vector<megrez::Offset<EnumVal>> *values() const { return GetPointer<const megrez::Vector<megrez::Offset<EnumVal>> *>(6); }
+	uint8_t is_union() const { return GetField<uint8_t>(8, 0); }
+	const Type *underlying_type() const { return GetPointer<const Type *>(10); }
+	const megrez::String *documentation() const { return GetPointer<const megrez::String *>(12); }
+	bool KeyCompareLessThan(const Enum *o) const {
+		auto key = o->name();
+		return KeyCompareWithValue(key ? key->view() : megrez::StringRef()) < 0;
+	}
+	int KeyCompareWithValue(megrez::StringRef val) const {
+		auto key = name();
+		return (key ? key->view() : megrez::StringRef()).compare(val);
+	}
+	bool Verify(megrez::Verifier &verifier) const {
+		return VerifyInfoStart(verifier) &&
+			VerifyOffset(verifier, 4) && verifier.VerifyString(name()) &&
+			VerifyOffset(verifier, 6) && verifier.VerifyVector(values()) &&
+			verifier.VerifyVectorOfInfos(values()) &&
+			VerifyField<uint8_t>(verifier, 8) &&
+			VerifyOffset(verifier, 10) && verifier.VerifyInfo(underlying_type()) &&
+			VerifyOffset(verifier, 12) && verifier.VerifyString(documentation()) &&
+			verifier.EndInfo();
+	}
+};
+
+struct EnumBuilder {
+	megrez::MegrezBuilder &mb_;
+	megrez::uofs_t start_;
+	void add_name(megrez::Offset<megrez::String> name) { mb_.AddOffset(4, name); }
+	void add_name(megrez::StringRef name) { mb_.AddOffset(4, mb_.CreateString(name)); }
+	void add_values(megrez::Offset<megrez::Vector<megrez::Offset<EnumVal>>> values) { mb_.AddOffset(6, values); }
+	void add_is_union(uint8_t is_union) { mb_.AddElement<uint8_t>(8, is_union, 0); }
+	void add_underlying_type(megrez::Offset<Type> underlying_type) { mb_.AddOffset(10, underlying_type); }
+	void add_documentation(megrez::Offset<megrez::String> documentation) { mb_.AddOffset(12, documentation); }
+	void add_documentation(megrez::StringRef documentation) { mb_.AddOffset(12, mb_.CreateString(documentation)); }
+	EnumBuilder(megrez::MegrezBuilder &_mb) : mb_(_mb) { start_ = mb_.StartInfo(); }
+	megrez::Offset<Enum> Finish() { return megrez::Offset<Enum>(mb_.EndInfo(start_, 5)); }
+	megrez::Offset<Enum> FinishShared() { return megrez::Offset<Enum>(mb_.EndSharedInfo(start_, 5)); }
+};
+
+inline megrez::Offset<Enum> CreateEnum(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  megrez::Offset<megrez::Vector<megrez::Offset<EnumVal>>> values,
+	  uint8_t is_union,
+	  megrez::Offset<Type> underlying_type,
+	  megrez::Offset<megrez::String> documentation) {
+
+	EnumBuilder builder_(_mb);
+	builder_.add_documentation(documentation);
+	builder_.add_underlying_type(underlying_type);
+	builder_.add_values(values);
+	builder_.add_name(name);
+	builder_.add_is_union(is_union);
+	return builder_.Finish();
+}
+
+inline megrez::Offset<Enum> CreateEnum(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::StringRef name,
+	  megrez::Offset<megrez::Vector<megrez::Offset<EnumVal>>> values,
+	  uint8_t is_union,
+	  megrez::Offset<Type> underlying_type,
+	  megrez::StringRef documentation) {
+
+	auto name_ = _mb.CreateString(name);
+	auto documentation_ = _mb.CreateString(documentation);
+	EnumBuilder builder_(_mb);
+	builder_.add_documentation(documentation_);
+	builder_.add_underlying_type(underlying_type);
+	builder_.add_values(values);
+	builder_.add_name(name_);
+	builder_.add_is_union(is_union);
+	return builder_.Finish();
+}
+
+// Every field is written, so all offsets have to be set. Use CreateEnum
+// when some of them are absent.
+inline megrez::Offset<Enum> CreateEnumFast(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  megrez::Offset<megrez::Vector<megrez::Offset<EnumVal>>> values,
+	  uint8_t is_union,
+	  megrez::Offset<Type> underlying_type,
+	  megrez::Offset<megrez::String> documentation) {
+
+	static constexpr megrez::vofs_t vtable[] = { 14, 21, 4, 8, 20, 12, 16 };
+	auto info_ = _mb.ReserveFixedInfo(vtable, 4);
+	_mb.SetFixedOffset(info_, 4, name);
+	_mb.SetFixedOffset(info_, 8, values);
+	_mb.SetFixedOffset(info_, 12, underlying_type);
+	_mb.SetFixedOffset(info_, 16, documentation);
+	_mb.SetFixedField<uint8_t>(info_, 20, is_union);
+	return megrez::Offset<Enum>(info_);
+}
+
+struct Field : private megrez::Info {
+	const megrez::String *name() const { return GetPointer<const megrez::String *>(4); }
+	const Type *type() const { return GetPointer<const Type *>(6); }
+	uint16_t id() const { return GetField<uint16_t>(8, 0); }
+	uint16_t offset() const { return GetField<uint16_t>(10, 0); }
+	int64_t default_integer() const { return GetField<int64_t>(12, 0); }
+	double default_real() const { return GetField<double>(14, 0); }
+	uint8_t deprecated() const { return GetField<uint8_t>(16, 0); }
+	uint8_t key() const { return GetField<uint8_t>(18, 0); }
+	uint16_t padding() const { return GetField<uint16_t>(20, 0); }
+	const megrez::String *documentation() const { return GetPointer<const megrez::String *>(22); }
+	bool KeyCompareLessThan(const Field *o) const {
+		auto key = o->name();
+		return KeyCompareWithValue(key ? key->view() : megrez::StringRef()) < 0;
+	}
+	int KeyCompareWithValue(megrez::StringRef val) const {
+		auto key = name();
+		return (key ? key->view() : megrez::StringRef()).compare(val);
+	}
+	bool Verify(megrez::Verifier &verifier) const {
+		return VerifyInfoStart(verifier) &&
+			VerifyOffset(verifier, 4) && verifier.VerifyString(name()) &&
+			VerifyOffset(verifier, 6) && verifier.VerifyInfo(type()) &&
+			VerifyField<uint16_t>(verifier, 8) &&
+			VerifyField<uint16_t>(verifier, 10) &&
+			VerifyField<int64_t>(verifier, 12) &&
+			VerifyField<double>(verifier, 14) &&
+			VerifyField<uint8_t>(verifier, 16) &&
+			VerifyField<uint8_t>(verifier, 18) &&
+			VerifyField<uint16_t>(verifier, 20) &&
+			VerifyOffset(verifier, 22) && verifier.VerifyString(documentation()) &&
+			verifier.EndInfo();
+	}
+};
+
+struct FieldBuilder {
+	megrez::MegrezBuilder &mb_;
+	megrez::uofs_t start_;
+	void add_name(megrez::Offset<megrez::String> name) { mb_.AddOffset(4, name); }
+	void add_name(megrez::StringRef name) { mb_.AddOffset(4, mb_.CreateString(name)); }
+	void add_type(megrez::Offset<Type> type) { mb_.AddOffset(6, type); }
+	void add_id(uint16_t id) { mb_.AddElement<uint16_t>(8, id, 0); }
+	void add_offset(uint16_t offset) { mb_.AddElement<uint16_t>(10, offset, 0); }
+	void add_default_integer(int64_t default_integer) { mb_.AddElement<int64_t>(12, default_integer, 0); }
+	void add_default_real(double default_real) { mb_.AddElement<double>(14, default_real, 0); }
+	void add_deprecated(uint8_t deprecated) { mb_.AddElement<uint8_t>(16, deprecated, 0); }
+	void add_key(uint8_t key) { mb_.AddElement<uint8_t>(18, key, 0); }
+	void add_padding(uint16_t padding) { mb_.AddElement<uint16_t>(20, padding, 0); }
+	void add_documentation(megrez::Offset<megrez::String> documentation) { mb_.AddOffset(22, documentation); }
+	void add_documentation(megrez::StringRef documentation) { mb_.AddOffset(22, mb_.CreateString(documentation)); }
+	FieldBuilder(megrez::MegrezBuilder &_mb) : mb_(_mb) { start_ = mb_.StartInfo(); }
+	megrez::Offset<Field> Finish() { return megrez::Offset<Field>(mb_.EndInfo(start_, 10)); }
+	megrez::Offset<Field> FinishShared() { return megrez::Offset<Field>(mb_.EndSharedInfo(start_, 10)); }
+};
+
+inline megrez::Offset<Field> CreateField(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  megrez::Offset<Type> type,
+	  uint16_t id,
+	  uint16_t offset,
+	  int64_t default_integer,
+	  double default_real,
+	  uint8_t deprecated,
+	  uint8_t key,
+	  uint16_t padding,
+	  megrez::Offset<megrez::String> documentation) {
+
+	FieldBuilder builder_(_mb);
+	builder_.add_default_real(default_real);
+	builder_.add_default_integer(default_integer);
+	builder_.add_documentation(documentation);
+	builder_.add_type(type);
+	builder_.add_name(name);
+	builder_.add_padding(padding);
+	builder_.add_offset(offset);
+	builder_.add_id(id);
+	builder_.add_key(key);
+	builder_.add_deprecated(deprecated);
+	return builder_.Finish();
+}
+
+inline megrez::Offset<Field> CreateField(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::StringRef name,
+	  megrez::Offset<Type> type,
+	  uint16_t id,
+	  uint16_t offset,
+	  int64_t default_integer,
+	  double default_real,
+	  uint8_t deprecated,
+	  uint8_t key,
+	  uint16_t padding,
+	  megrez::StringRef documentation) {
+
+	auto name_ = _mb.CreateString(name);
+	auto documentation_ = _mb.CreateString(documentation);
+	FieldBuilder builder_(_mb);
+	builder_.add_default_real(default_real);
+	builder_.add_default_integer(default_integer);
+	builder_.add_documentation(documentation_);
+	builder_.add_type(type);
+	builder_.add_name(name_);
+	builder_.add_padding(padding);
+	builder_.add_offset(offset);
+	builder_.add_id(id);
+	builder_.add_key(key);
+	builder_.add_deprecated(deprecated);
+	return builder_.Finish();
+}
+
+// Every field is written, so all offsets have to be set. Use CreateField
+// when some of them are absent.
+inline megrez::Offset<Field> CreateFieldFast(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  megrez::Offset<Type> type,
+	  uint16_t id,
+	  uint16_t offset,
+	  int64_t default_integer,
+	  double default_real,
+	  uint8_t deprecated,
+	  uint8_t key,
+	  uint16_t padding,
+	  megrez::Offset<megrez::String> documentation) {
+
+	static constexpr megrez::vofs_t vtable[] = { 24, 44, 24, 28, 36, 38, 8, 16, 42, 43, 40, 32 };
+	auto info_ = _mb.ReserveFixedInfo(vtable, 8);
+	_mb.SetFixedField<int64_t>(info_, 8, default_integer);
+	_mb.SetFixedField<double>(info_, 16, default_real);
+	_mb.SetFixedOffset(info_, 24, name);
+	_mb.SetFixedOffset(info_, 28, type);
+	_mb.SetFixedOffset(info_, 32, documentation);
+	_mb.SetFixedField<uint16_t>(info_, 36, id);
+	_mb.SetFixedField<uint16_t>(info_, 38, offset);
+	_mb.SetFixedField<uint16_t>(info_, 40, padding);
+	_mb.SetFixedField<uint8_t>(info_, 42, deprecated);
+	_mb.SetFixedField<uint8_t>(info_, 43, key);
+	return megrez::Offset<Field>(info_);
+}
+
+struct Object : private megrez::Info {
+	const megrez::String *name() const { return GetPointer<const megrez::String *>(4); }
+	const megrez::Vector<megrez::Offset<Field>> *fields() const { return GetPointer<const megrez::Vector<megrez::Offset<Field>> *>(6); }
+	uint8_t is_struct() const { return GetField<uint8_t>(8, 0); }
+	int32_t minalign() const { return GetField<int32_t>(10, 0); }
+	int32_t bytesize() const { return GetField<int32_t>(12, 0); }
+	const megrez::String *documentation() const { return GetPointer<const megrez::String *>(14); }
+	bool KeyCompareLessThan(const Object *o) const {
+		auto key = o->name();
+		return KeyCompareWithValue(key ? key->view() : megrez::StringRef()) < 0;
+	}
+	int KeyCompareWithValue(megrez::StringRef val) const {
+		auto key = name();
+		return (key ? key->view() : megrez::StringRef()).compare(val);
+	}
+	bool Verify(megrez::Verifier &verifier) const {
+		return VerifyInfoStart(verifier) &&
+			VerifyOffset(verifier, 4) && verifier.VerifyString(name()) &&
+			VerifyOffset(verifier, 6) && verifier.VerifyVector(fields()) &&
+			verifier.VerifyVectorOfInfos(fields()) &&
+			VerifyField<uint8_t>(verifier, 8) &&
+			VerifyField<int32_t>(verifier, 10) &&
+			VerifyField<int32_t>(verifier, 12) &&
+			VerifyOffset(verifier, 14) && verifier.VerifyString(documentation()) &&
+			verifier.EndInfo();
+	}
+};
+
+struct ObjectBuilder {
+	megrez::MegrezBuilder &mb_;
+	megrez::uofs_t start_;
+	void add_name(megrez::Offset<megrez::String> name) { mb_.AddOffset(4, name); }
+	void add_name(megrez::StringRef name) { mb_.AddOffset(4, mb_.CreateString(name)); }
+	void add_fields(megrez::Offset<megrez::Vector<megrez::Offset<Field>>> fields) { mb_.AddOffset(6, fields); }
+	void add_is_struct(uint8_t is_struct) { mb_.AddElement<uint8_t>(8, is_struct, 0); }
+	void add_minalign(int32_t minalign) { mb_.AddElement<int32_t>(10, minalign, 0); }
+	void add_bytesize(int32_t bytesize) { mb_.AddElement<int32_t>(12, bytesize, 0); }
+	void add_documentation(megrez::Offset<megrez::String> documentation) { mb_.AddOffset(14, documentation); }
+	void add_documentation(megrez::StringRef documentation) { mb_.AddOffset(14, mb_.CreateString(documentation)); }
+	ObjectBuilder(megrez::MegrezBuilder &_mb) : mb_(_mb) { start_ = mb_.StartInfo(); }
+	megrez::Offset<Object> Finish() { return megrez::Offset<Object>(mb_.EndInfo(start_, 6)); }
+	megrez::Offset<Object> FinishShared() { return megrez::Offset<Object>(mb_.EndSharedInfo(start_, 6)); }
+};
+
+inline megrez::Offset<Object> CreateObject(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Field>>> fields,
+	  uint8_t is_struct,
+	  int32_t minalign,
+	  int32_t bytesize,
+	  megrez::Offset<megrez::String> documentation) {
+
+	ObjectBuilder builder_(_mb);
+	builder_.add_documentation(documentation);
+	builder_.add_bytesize(bytesize);
+	builder_.add_minalign(minalign);
+	builder_.add_fields(fields);
+	builder_.add_name(name);
+	builder_.add_is_struct(is_struct);
+	return builder_.Finish();
+}
+
+inline megrez::Offset<Object> CreateObject(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::StringRef name,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Field>>> fields,
+	  uint8_t is_struct,
+	  int32_t minalign,
+	  int32_t bytesize,
+	  megrez::StringRef documentation) {
+
+	auto name_ = _mb.CreateString(name);
+	auto documentation_ = _mb.CreateString(documentation);
+	ObjectBuilder builder_(_mb);
+	builder_.add_documentation(documentation_);
+	builder_.add_bytesize(bytesize);
+	builder_.add_minalign(minalign);
+	builder_.add_fields(fields);
+	builder_.add_name(name_);
+	builder_.add_is_struct(is_struct);
+	return builder_.Finish();
+}
+
+// Every field is written, so all offsets have to be set. Use CreateObject
+// when some of them are absent.
+inline megrez::Offset<Object> CreateObjectFast(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::String> name,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Field>>> fields,
+	  uint8_t is_struct,
+	  int32_t minalign,
+	  int32_t bytesize,
+	  megrez::Offset<megrez::String> documentation) {
+
+	static constexpr megrez::vofs_t vtable[] = { 16, 25, 4, 8, 24, 12, 16, 20 };
+	auto info_ = _mb.ReserveFixedInfo(vtable, 4);
+	_mb.SetFixedOffset(info_, 4, name);
+	_mb.SetFixedOffset(info_, 8, fields);
+	_mb.SetFixedField<int32_t>(info_, 12, minalign);
+	_mb.SetFixedField<int32_t>(info_, 16, bytesize);
+	_mb.SetFixedOffset(info_, 20, documentation);
+	_mb.SetFixedField<uint8_t>(info_, 24, is_struct);
+	return megrez::Offset<Object>(info_);
+}
+
+struct Schema : private megrez::Info {
+	const megrez::Vector<megrez::Offset<Object>> *objects() const { return GetPointer<const megrez::Vector<megrez::Offset<Object>> *>(4); }
+	const megrez::Vector<megrez::Offset<Enum>> *enums() const { return GetPointer<const megrez::Vector<megrez::Offset<Enum>> *>(6); }
+	const megrez::String *name_space() const { return GetPointer<const megrez::String *>(8); }
+	int32_t main_type() const { return GetField<int32_t>(10, -1); }
+	bool Verify(megrez::Verifier &verifier) const {
+		return VerifyInfoStart(verifier) &&
+			VerifyOffset(verifier, 4) && verifier.VerifyVector(objects()) &&
+			verifier.VerifyVectorOfInfos(objects()) &&
+			VerifyOffset(verifier, 6) && verifier.VerifyVector(enums()) &&
+			verifier.VerifyVectorOfInfos(enums()) &&
+			VerifyOffset(verifier, 8) && verifier.VerifyString(name_space()) &&
+			VerifyField<int32_t>(verifier, 10) &&
+			verifier.EndInfo();
+	}
+};
+
+struct SchemaBuilder {
+	megrez::MegrezBuilder &mb_;
+	megrez::uofs_t start_;
+	void add_objects(megrez::Offset<megrez::Vector<megrez::Offset<Object>>> objects) { mb_.AddOffset(4, objects); }
+	void add_enums(megrez::Offset<megrez::Vector<megrez::Offset<Enum>>> enums) { mb_.AddOffset(6, enums); }
+	void add_name_space(megrez::Offset<megrez::String> name_space) { mb_.AddOffset(8, name_space); }
+	void add_name_space(megrez::StringRef name_space) { mb_.AddOffset(8, mb_.CreateString(name_space)); }
+	void add_main_type(int32_t main_type) { mb_.AddElement<int32_t>(10, main_type, -1); }
+	SchemaBuilder(megrez::MegrezBuilder &_mb) : mb_(_mb) { start_ = mb_.StartInfo(); }
+	megrez::Offset<Schema> Finish() { return megrez::Offset<Schema>(mb_.EndInfo(start_, 4)); }
+	megrez::Offset<Schema> FinishShared() { return megrez::Offset<Schema>(mb_.EndSharedInfo(start_, 4)); }
+};
+
+inline megrez::Offset<Schema> CreateSchema(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Object>>> objects,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Enum>>> enums,
+	  megrez::Offset<megrez::String> name_space,
+	  int32_t main_type) {
+
+	SchemaBuilder builder_(_mb);
+	builder_.add_main_type(main_type);
+	builder_.add_name_space(name_space);
+	builder_.add_enums(enums);
+	builder_.add_objects(objects);
+	return builder_.Finish();
+}
+
+inline megrez::Offset<Schema> CreateSchema(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Object>>> objects,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Enum>>> enums,
+	  megrez::StringRef name_space,
+	  int32_t main_type) {
+
+	auto name_space_ = _mb.CreateString(name_space);
+	SchemaBuilder builder_(_mb);
+	builder_.add_main_type(main_type);
+	builder_.add_name_space(name_space_);
+	builder_.add_enums(enums);
+	builder_.add_objects(objects);
+	return builder_.Finish();
+}
+
+// Every field is written, so all offsets have to be set. Use CreateSchema
+// when some of them are absent.
+inline megrez::Offset<Schema> CreateSchemaFast(
+	  megrez::MegrezBuilder &_mb,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Object>>> objects,
+	  megrez::Offset<megrez::Vector<megrez::Offset<Enum>>> enums,
+	  megrez::Offset<megrez::String> name_space,
+	  int32_t main_type) {
+
+	static constexpr megrez::vofs_t vtable[] = { 12, 20, 4, 8, 12, 16 };
+	auto info_ = _mb.ReserveFixedInfo(vtable, 4);
+	_mb.SetFixedOffset(info_, 4, objects);
+	_mb.SetFixedOffset(info_, 8, enums);
+	_mb.SetFixedOffset(info_, 12, name_space);
+	_mb.SetFixedField<int32_t>(info_, 16, main_type);
+	return megrez::Offset<Schema>(info_);
+}
+
+inline const Schema *GetSchema(const void *buf) { return megrez::GetRoot<Schema>(buf); }
+
+inline const Schema *GetSizePrefixedSchema(const void *buf) { return megrez::GetSizePrefixedRoot<Schema>(buf); }
+
+inline bool VerifySchemaBuffer(megrez::Verifier &verifier) { return verifier.VerifyBuffer<Schema>(); }
+
+inline bool VerifySizePrefixedSchemaBuffer(megrez::Verifier &verifier) {
+	return verifier.VerifySizePrefixedBuffer<Schema>();
+}
+
+}; // namespace megrez
+}; // namespace reflection
+#endif  // MEGREZ_GENERATED_MEGREZ_REFLECTION_REFLECTION_MGZ_H_
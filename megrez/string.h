@@ -18,12 +18,58 @@ limitations under the License.
 #define MEGREZ_STRING_H_
 
 #include <string.h>
+#include <string>
 #include "megrez/vector.h"
 
 namespace megrez {
 
-struct String : public Vector<char> {
-	const char *c_str() const { return reinterpret_cast<const char *>(Data()); }
+// Non-owning view of a run of characters, so string fields can be written
+// straight from a literal, a std::string or a pointer/length pair.
+class StringRef {
+ private:
+	const char *data_;
+	size_t size_;
+
+ public:
+	StringRef() : data_(""), size_(0) {}
+	StringRef(const char *str) : data_(str), size_(strlen(str)) {}
+	StringRef(const char *str, size_t len) : data_(str), size_(len) {}
+	StringRef(const std::string &str) : data_(str.data()), size_(str.size()) {}
+
+	const char *data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return !size_; }
+	const char *begin() const { return data_; }
+	const char *end() const { return data_ + size_; }
+	char operator[](size_t i) const { return data_[i]; }
+	std::string str() const { return std::string(data_, size_); }
+
+	// Bytewise, like strcmp but with embedded zeros allowed.
+	int compare(StringRef other) const {
+		auto cmp = memcmp(data_, other.data_, size_ < other.size_ ? size_ : other.size_);
+		if (cmp) return cmp;
+		return size_ < other.size_ ? -1 : size_ > other.size_;
+	}
+	bool operator==(StringRef other) const {
+		return size_ == other.size_ && !memcmp(data_, other.data_, size_);
+	}
+	bool operator!=(StringRef other) const { return !(*this == other); }
+	bool operator<(StringRef other) const { return compare(other) < 0; }
+};
+
+template<typename ReadPolicy> 
+struct BasicString : public Vector<char, ReadPolicy> {
+	const char *c_str() const { return reinterpret_cast<const char *>(this->Data()); }
+	// Uses the stored length, so embedded zeros are kept and nothing is scanned.
+	StringRef view() const { return StringRef(c_str(), this->Length()); }
+	std::string str() const { return std::string(c_str(), this->Length()); }
+};
+
+typedef BasicString<AlignedReads> String;
+
+template<typename Q, typename ReadPolicy> 
+struct WithReadPolicy<BasicString<Q>, ReadPolicy> {
+	typedef BasicString<ReadPolicy> type;
 };
 
 } // namespace megrez
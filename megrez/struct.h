@@ -26,14 +26,14 @@ class Struct {
 	uint8_t data_[1];
 	
  public:
-	template<typename T> 
-	T GetField(uofs_t o) const { return ReadScalar<T>(&data_[o]); }
+	template<typename T, typename ReadPolicy = AlignedReads> 
+	T GetField(uofs_t o) const { return ReadScalar<T, ReadPolicy>(&data_[o]); }
 	template<typename T> 
 	T GetStruct(uofs_t o) const { return reinterpret_cast<T>(&data_[o]); }
-	template<typename T> 
+	template<typename T, typename ReadPolicy = AlignedReads> 
 	T GetPointer(uofs_t o) const {
 		auto p = &data_[o];
-		return reinterpret_cast<T>(p + ReadScalar<uofs_t>(p));
+		return reinterpret_cast<T>(p + ReadScalar<uofs_t, ReadPolicy>(p));
 	}
 
 };
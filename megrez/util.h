@@ -22,7 +22,9 @@ limitations under the License.
 #include <string>
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 #include "megrez/basic.h"
+#include "megrez/mapped.h"
 
 namespace megrez {
 
@@ -46,13 +48,27 @@ std::string IntToStringHex(T i) {
 }
 
 
-template<typename T> 
+template<typename T, typename ReadPolicy = AlignedReads> 
 const T *GetRoot(const void *buf) {
 	EndianCheck();
 	return reinterpret_cast<const T *>(reinterpret_cast<const uint8_t *>(buf) +
-		EndianScalar(*reinterpret_cast<const uofs_t *>(buf)));
+		ReadScalar<uofs_t, ReadPolicy>(buf));
+}
+
+// The root of a buffer that is going to be changed in place.
+template<typename T, typename ReadPolicy = AlignedReads> 
+T *GetMutableRoot(void *buf) {
+	return const_cast<T *>(GetRoot<T, ReadPolicy>(buf));
+}
+
+// For buffers made by MegrezBuilder::FinishSizePrefixed.
+template<typename T, typename ReadPolicy = AlignedReads> 
+const T *GetSizePrefixedRoot(const void *buf) {
+	return GetRoot<T, ReadPolicy>(reinterpret_cast<const uint8_t *>(buf) + sizeof(uofs_t));
 }
 
+inline uofs_t GetPrefixedSize(const void *buf) { return ReadScalar<uofs_t>(buf); }
+
 
 inline int64_t StringToInt(const char *str) {
 	#ifdef _MSC_VER
@@ -62,7 +78,16 @@ inline int64_t StringToInt(const char *str) {
 	#endif
 }
 
+// Binary files are read through a MappedFile: one copy out of the page
+// cache instead of a character at a time. Use a MappedFile directly to
+// avoid even that copy.
 inline bool LoadFile(const char *name, bool binary, std::string *buf) {
+	if (binary) {
+		MappedFile file;
+		if (!file.Open(name, MappedFile::kSequential)) return false;
+		buf->assign(reinterpret_cast<const char *>(file.data()), file.size());
+		return true;
+	}
 	std::ifstream ifs(name, binary ? std::ifstream::binary : std::ifstream::in);
 	if (!ifs.is_open()) return false;
 	*buf = std::string(std::istreambuf_iterator<char>(ifs),
@@ -81,6 +106,44 @@ inline bool SaveFile(const char *name, const std::string &buf, bool binary) {
 	return SaveFile(name, buf.c_str(), buf.size(), binary);
 }
 
+// Leaves a file that already holds exactly `buf` untouched, so that its
+// modification time only changes with its contents and build systems
+// don't rebuild what depends on it. The old contents are compared as
+// bytes, which is also the quick way to read them.
+inline bool SaveFileIfChanged(const char *name, const std::string &buf, bool binary) {
+	std::string old;
+	if (LoadFile(name, true, &old) && old == buf) return true;
+	return SaveFile(name, buf, binary);
+}
+
+inline std::string StripExtension(const std::string &filename) {
+	size_t i = filename.find_last_of(".");
+	return i != std::string::npos ? filename.substr(0, i) : filename;
+}
+
+// The directory part of a path, with its trailing separator, or "".
+inline std::string StripFileName(const std::string &filename) {
+	size_t i = filename.find_last_of("\\/");
+	return i != std::string::npos ? filename.substr(0, i + 1) : "";
+}
+
+// A name that is the same for every path to the same file, where the
+// platform can tell.
+inline std::string AbsolutePath(const std::string &filename) {
+	#if defined(_WIN32)
+		char abs[_MAX_PATH];
+		return _fullpath(abs, filename.c_str(), _MAX_PATH) ? std::string(abs) : filename;
+	#elif defined(__unix__) || defined(__APPLE__)
+		char *abs = realpath(filename.c_str(), nullptr);
+		if (!abs) return filename;
+		std::string path(abs);
+		free(abs);
+		return path;
+	#else
+		return filename;
+	#endif
+}
+
 
 
 inline vofs_t FieldIndexToOffset(vofs_t field_id) {
@@ -92,6 +155,16 @@ inline size_t PaddingBytes(size_t buf_size, size_t scalar_size) {
 	return ((~buf_size) + 1) & (scalar_size - 1);
 }
 
+// 32-bit FNV-1a, used to index byte strings inside the builder.
+inline uint32_t HashBytes(const uint8_t *bytes, size_t len) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 inline size_t LookupEnum(const char **names, const char *name) {
 	for (const char **p = names; *p; p++)
 		if (!strcmp(*p, name))
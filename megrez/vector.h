@@ -19,66 +19,283 @@ limitations under the License.
 
 #include <algorithm>
 #include <assert.h>
+#include <cstddef>
 #include <cstring>
+#include <iterator>
+#include <type_traits>
+#include "megrez/allocator.h"
 #include "megrez/basic.h"
+#include "megrez/endian.h"
 
 namespace megrez {
 
+// Random access iterator over the elements of a Vector. Elements are read
+// like Vector::Get does: scalars in native byte order, offsets followed.
+template<typename T, typename ReadPolicy = AlignedReads> 
+class VectorIterator {
+ private:
+	typedef IndirectHelper<T, ReadPolicy> helper;
+	const uint8_t *p_;
+
+ public:
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef typename helper::return_type reference;
+	typedef typename std::remove_cv<
+		typename std::remove_reference<reference>::type>::type value_type;
+	typedef typename std::remove_reference<reference>::type *pointer;
+	typedef ptrdiff_t difference_type;
+
+	VectorIterator() : p_(nullptr) {}
+	explicit VectorIterator(const uint8_t *p) : p_(p) {}
+
+	reference operator*() const { return helper::Read(p_, 0); }
+	reference operator[](difference_type n) const {
+		return helper::Read(p_ + n * static_cast<difference_type>(helper::element_size), 0);
+	}
+
+	VectorIterator &operator++() { p_ += helper::element_size; return *this; }
+	VectorIterator &operator--() { p_ -= helper::element_size; return *this; }
+	VectorIterator operator++(int) { auto it = *this; ++*this; return it; }
+	VectorIterator operator--(int) { auto it = *this; --*this; return it; }
+	VectorIterator &operator+=(difference_type n) {
+		p_ += n * static_cast<difference_type>(helper::element_size);
+		return *this;
+	}
+	VectorIterator &operator-=(difference_type n) { return *this += -n; }
+	VectorIterator operator+(difference_type n) const { return VectorIterator(*this) += n; }
+	VectorIterator operator-(difference_type n) const { return VectorIterator(*this) -= n; }
+	friend VectorIterator operator+(difference_type n, const VectorIterator &it) { return it + n; }
+	difference_type operator-(const VectorIterator &other) const {
+		return (p_ - other.p_) / static_cast<difference_type>(helper::element_size);
+	}
+
+	bool operator==(const VectorIterator &other) const { return p_ == other.p_; }
+	bool operator!=(const VectorIterator &other) const { return p_ != other.p_; }
+	bool operator<(const VectorIterator &other) const { return p_ < other.p_; }
+	bool operator>(const VectorIterator &other) const { return p_ > other.p_; }
+	bool operator<=(const VectorIterator &other) const { return p_ <= other.p_; }
+	bool operator>=(const VectorIterator &other) const { return p_ >= other.p_; }
+};
+
+// Element type Vector::CopyTo writes: scalars, and structs for vectors of
+// structs. Void for offsets, which can't be copied out.
+template<typename T> 
+struct CopyElement {
+	typedef T type;
+};
+
+template<typename T> 
+struct CopyElement<const T *> {
+	typedef T type;
+};
+
 template<typename T> 
+struct CopyElement<Offset<T>> {
+	typedef void type;
+};
+
+// A vector inside a buffer. ReadPolicy selects aligned or memcpy loads of
+// the length and the elements, see basic.h.
+template<typename T, typename ReadPolicy = AlignedReads> 
 class Vector {
  protected:
+	typedef IndirectHelper<T, ReadPolicy> helper;
 	Vector();
 	const uint8_t *Data() const {
-		return reinterpret_cast<const uint8_t *>(&length_ + 1);
+		return length_ + sizeof(uofs_t);
 	}
-	uofs_t length_;
+	uint8_t length_[sizeof(uofs_t)];  // bytes, so the vector itself is unaligned
 	
  public:
-	uofs_t Length() const { return EndianScalar(length_); }
-	typedef typename IndirectHelper<T>::return_type return_type;
+	uofs_t Length() const { return ReadScalar<uofs_t, ReadPolicy>(length_); }
+	typedef typename helper::return_type return_type;
 	return_type Get(uofs_t i) const {
 		assert(i < Length());
-		return IndirectHelper<T>::Read(Data(), i);
+		return helper::Read(Data(), i);
+	}
+
+	// In place updates. Scalars are overwritten with Mutate; structs and infos
+	// are changed through the pointer GetMutableObject returns. Changing the
+	// key of an element breaks the order LookupByKey relies on.
+	void Mutate(uofs_t i, T val) {
+		static_assert(std::is_arithmetic<T>::value, "only scalar elements can be overwritten");
+		assert(i < Length());
+		WriteScalar<T, ReadPolicy>(const_cast<uint8_t *>(Data()) + i * sizeof(T), val);
+	}
+
+	typedef typename std::remove_const<typename std::remove_pointer<
+		typename std::remove_reference<return_type>::type>::type>::type *mutable_return_type;
+	mutable_return_type GetMutableObject(uofs_t i) {
+		static_assert(!std::is_arithmetic<T>::value, "use Mutate for scalar elements");
+		return const_cast<mutable_return_type>(AddressOf(Get(i)));
 	}
 
 	const void *GetStructFromOffset(size_t o) const {
 		return reinterpret_cast<const void *>(Data() + o);
 	}
 
+	typedef VectorIterator<T, ReadPolicy> const_iterator;
+	typedef const_iterator iterator;
+	const_iterator begin() const { return const_iterator(Data()); }
+	const_iterator end() const {
+		return const_iterator(Data() + Length() * helper::element_size);
+	}
+	uofs_t size() const { return Length(); }
+	bool empty() const { return !Length(); }
+	return_type operator[](uofs_t i) const { return Get(i); }
+
+	// The elements in place, without copying. Structs can be used as is;
+	// scalars are stored little-endian, so they are only native on
+	// little-endian hosts. Vectors of offsets return the relative offsets.
+	typedef typename helper::data_type data_type;
+	data_type data() const { return reinterpret_cast<data_type>(Data()); }
+
+	// Copy the first `n` elements to `dst` in one go, converting scalars to
+	// native byte order. Structs are copied as they are, vectors of offsets
+	// can't be copied.
+	typedef typename CopyElement<T>::type copy_type;
+	void CopyTo(copy_type *dst, uofs_t n) const {
+		static_assert(!std::is_void<copy_type>::value, "offsets can't be copied out");
+		assert(n <= Length());
+		EndianCopy<copy_type>(dst, Data(), n);
+	}
+
+	// Binary search of a vector made by CreateVectorOfSortedInfos, using the
+	// KeyCompareWithValue function generated for infos with a key field.
+	// Returns nullptr when no element has this key.
+	template<typename K> 
+	return_type LookupByKey(K key) const {
+		uofs_t lo = 0, hi = Length();
+		while (lo < hi) {
+			auto mid = lo + (hi - lo) / 2;
+			auto elem = helper::Read(Data(), mid);
+			auto cmp = elem->KeyCompareWithValue(key);
+			if (cmp < 0) lo = mid + 1;
+			else if (cmp > 0) hi = mid;
+			else return elem;
+		}
+		return nullptr;
+	}
+
+ private:
+	template<typename U> 
+	static const U *AddressOf(const U &elem) { return &elem; }
+	template<typename U> 
+	static const U *AddressOf(const U *elem) { return elem; }
+};
+
+template<typename T, typename Q, typename ReadPolicy> 
+struct WithReadPolicy<Vector<T, Q>, ReadPolicy> {
+	typedef Vector<T, ReadPolicy> type;
+};
+
+// A finished buffer taken out of a builder. Owns the block it was built in
+// and hands it back to its allocator when destroyed.
+class DetachedBuffer {
+ private:
+	Allocator *allocator_;
+	uint8_t *buf_;
+	size_t reserved_;
+	uint8_t *cur_;
+	size_t size_;
+
+	void destroy() {
+		if (buf_) allocator_->deallocate(buf_, reserved_);
+		buf_ = cur_ = nullptr;
+		reserved_ = size_ = 0;
+	}
+
+ public:
+	DetachedBuffer()
+		: allocator_(nullptr), buf_(nullptr), reserved_(0), cur_(nullptr), size_(0) {}
+	DetachedBuffer(Allocator *allocator, uint8_t *buf, size_t reserved,
+				   uint8_t *cur, size_t size)
+		: allocator_(allocator), buf_(buf), reserved_(reserved), cur_(cur), size_(size) {}
+	DetachedBuffer(DetachedBuffer &&other)
+		: allocator_(other.allocator_), buf_(other.buf_), reserved_(other.reserved_),
+			cur_(other.cur_), size_(other.size_) {
+		other.buf_ = other.cur_ = nullptr;
+		other.reserved_ = other.size_ = 0;
+	}
+	DetachedBuffer &operator=(DetachedBuffer &&other) {
+		if (this == &other) return *this;
+		destroy();
+		allocator_ = other.allocator_;
+		buf_ = other.buf_;
+		reserved_ = other.reserved_;
+		cur_ = other.cur_;
+		size_ = other.size_;
+		other.buf_ = other.cur_ = nullptr;
+		other.reserved_ = other.size_ = 0;
+		return *this;
+	}
+	DetachedBuffer(const DetachedBuffer &) = delete;
+	DetachedBuffer &operator=(const DetachedBuffer &) = delete;
+	~DetachedBuffer() { destroy(); }
+
+	const uint8_t *data() const { return cur_; }
+	uint8_t *data() { return cur_; }
+	size_t size() const { return size_; }
+	Allocator *allocator() const { return allocator_; }
 };
 
 class vector_downward {
  private:
-	uofs_t reserved_;
+	Allocator *allocator_;
+	size_t initial_size_;
+	size_t reserved_;  // may exceed uofs_t while growing a small-offset buffer
 	uint8_t *buf_;
 	uint8_t *cur_;
 
  public:
-	explicit vector_downward(uofs_t initial_size)
-		: reserved_(initial_size),
-			buf_(new uint8_t[reserved_]),
+	explicit vector_downward(uofs_t initial_size, Allocator *allocator = nullptr)
+		: allocator_(allocator ? allocator : &DefaultAllocator::instance()),
+			initial_size_(initial_size),
+			reserved_(initial_size),
+			buf_(allocator_->allocate(reserved_)),
 			cur_(buf_ + reserved_) {
 		assert((initial_size & (sizeof(max_scalar_t) - 1)) == 0);
 	}
-	~vector_downward() { delete[] buf_; }
+	~vector_downward() { allocator_->deallocate(buf_, reserved_); }
 	void clear() { cur_ = buf_ + reserved_; }
-	uofs_t growth_policy(uofs_t size) {
+
+	// Give up the current block, the written bytes stay valid in the returned
+	// buffer. A fresh block of the initial size is allocated for further use.
+	DetachedBuffer release() {
+		DetachedBuffer fb(allocator_, buf_, reserved_, cur_, size());
+		reserved_ = initial_size_;
+		buf_ = allocator_->allocate(reserved_);
+		cur_ = buf_ + reserved_;
+		return fb;
+	}
+
+	size_t growth_policy(size_t size) {
 		return (size / 2) & ~(sizeof(max_scalar_t) - 1);
 	}
 
-	uint8_t *make_space(uofs_t len) {
-		if (buf_ > cur_ - len) {
-			auto old_size = size();
-			reserved_ += std::max(len, growth_policy(reserved_));
-			auto new_buf = new uint8_t[reserved_];
-			auto new_cur = new_buf + reserved_ - old_size;
-			memcpy(new_cur, cur_, old_size);
-			cur_ = new_cur;
-			delete[] buf_;
-			buf_ = new_buf;
-		}
+	// Grow the block by at least `len` bytes.
+	void grow(size_t len) {
+		auto old_size = size();
+		auto old_reserved = reserved_;
+		// Keep the block size a multiple of max_scalar_t, alignment is
+		// computed from the end of the buffer.
+		auto aligned_len = (len + sizeof(max_scalar_t) - 1) &
+			~(sizeof(max_scalar_t) - 1);
+		reserved_ += std::max(aligned_len, growth_policy(reserved_));
+		buf_ = allocator_->reallocate_downward(buf_, old_reserved,
+											   reserved_, old_size);
+		cur_ = buf_ + reserved_ - old_size;
+	}
+
+	// Make room for `len` more bytes up front, when the final size is known.
+	void reserve(size_t len) {
+		if (static_cast<size_t>(cur_ - buf_) < len) grow(len - (cur_ - buf_));
+	}
+
+	uint8_t *make_space(size_t len) {
+		CheckLimit(len <= kMaxBufferSize - size());
+		if (static_cast<size_t>(cur_ - buf_) < len) grow(len);
 		cur_ -= len;
-		assert(size() < (1UL << (sizeof(sofs_t) * 8 - 1)) - 1);
 		return cur_;
 	}
 
@@ -90,12 +307,12 @@ class vector_downward {
 	uint8_t *data_at(uofs_t offset) { return buf_ + reserved_ - offset; }
 	void push(const uint8_t *bytes, size_t size) {
 		auto dest = make_space(size);
-		for (size_t i = 0; i < size; i++) dest[i] = bytes[i];
+		if (size) memcpy(dest, bytes, size);
 	}
 
 	void fill(size_t zero_pad_bytes) {
 		auto dest = make_space(zero_pad_bytes);
-		for (size_t i = 0; i < zero_pad_bytes; i++) dest[i] = 0;
+		memset(dest, 0, zero_pad_bytes);
 	}
 
 	void pop(size_t bytes_to_remove) { cur_ += bytes_to_remove; }
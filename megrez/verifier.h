@@ -0,0 +1,213 @@
+/* =====================================================================
+Copyright 2017 The Megrez Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+========================================================================*/
+
+#ifndef MEGREZ_VERIFIER_H_
+#define MEGREZ_VERIFIER_H_
+
+#include <stdint.h>
+#include "megrez/basic.h"
+#include "megrez/map.h"
+#include "megrez/string.h"
+#include "megrez/vector.h"
+
+namespace megrez {
+
+// Checks a buffer from an untrusted source before any of its accessors are
+// used: every offset, vtable, vector length and string terminator has to
+// stay inside the buffer. The depth and info limits bound the work done on
+// hostile input. Generated infos provide Verify(), which calls into this.
+// The verifier reads with UnalignedReads, so with check_alignment off it
+// can check buffers at any address.
+class Verifier {
+ private:
+	const uint8_t *buf_;
+	size_t size_;
+	size_t depth_;
+	size_t max_depth_;
+	size_t num_infos_;
+	size_t max_infos_;
+	bool check_alignment_;
+
+	size_t Position(const void *p) const {
+		return static_cast<size_t>(reinterpret_cast<const uint8_t *>(p) - buf_);
+	}
+
+ public:
+	Verifier(const uint8_t *buf, size_t buf_len, size_t max_depth = 64,
+			 size_t max_infos = 1000000, bool check_alignment = true)
+		: buf_(buf), size_(buf_len), depth_(0), max_depth_(max_depth),
+			num_infos_(0), max_infos_(max_infos), check_alignment_(check_alignment) {}
+
+	// `elem_len` bytes starting at `elem` lie inside the buffer.
+	bool Verify(const void *elem, size_t elem_len) const {
+		auto p = reinterpret_cast<const uint8_t *>(elem);
+		return p >= buf_ && elem_len <= size_ && Position(p) <= size_ - elem_len;
+	}
+
+	// Builders align every scalar to its size relative to the end of the
+	// buffer, which is itself aligned, so this is checked from the start.
+	bool VerifyAlignment(const void *elem, size_t alignment) const {
+		return !check_alignment_ || !(Position(elem) & (alignment - 1));
+	}
+
+	template<typename T> 
+	bool Verify(const void *elem) const {
+		return VerifyAlignment(elem, AlignOf<T>()) && Verify(elem, sizeof(T));
+	}
+
+	// Follow the offset stored at `p`. Returns what it refers to, or nullptr
+	// if that isn't inside the buffer.
+	const uint8_t *VerifyOffset(const uint8_t *p) const {
+		if (!Verify<uofs_t>(p)) return nullptr;
+		auto o = static_cast<size_t>(ReadScalar<uofs_t, UnalignedReads>(p));
+		// Offsets only point forward, a zero one can't have been written.
+		if (!o || o >= size_ - Position(p)) return nullptr;
+		return p + o;
+	}
+
+	// The vtable offset, the vtable and the object size of an info. Must be
+	// paired with EndInfo() once its fields are checked.
+	bool VerifyInfoStart(const uint8_t *info) {
+		if (++depth_ > max_depth_ || ++num_infos_ > max_infos_) return false;
+		if (!Verify<sofs_t>(info)) return false;
+		auto soffset = static_cast<int64_t>(ReadScalar<sofs_t, UnalignedReads>(info));
+		if (soffset < -static_cast<int64_t>(size_)) return false;
+		auto vtable = static_cast<int64_t>(Position(info)) - soffset;
+		if (vtable < 0 || vtable > static_cast<int64_t>(size_)) return false;
+		auto vt = buf_ + vtable;
+		if (!Verify<vofs_t>(vt) || !Verify(vt, 2 * sizeof(vofs_t))) return false;
+		auto vtsize = ReadScalar<vofs_t, UnalignedReads>(vt);
+		auto object_size = ReadScalar<vofs_t, UnalignedReads>(vt + sizeof(vofs_t));
+		return !(vtsize & (sizeof(vofs_t) - 1)) && vtsize >= 2 * sizeof(vofs_t) &&
+			   Verify(vt, vtsize) && object_size >= sizeof(sofs_t) &&
+			   Verify(info, object_size);
+	}
+
+	bool EndInfo() {
+		depth_--;
+		return true;
+	}
+
+	template<typename T> 
+	bool VerifyInfo(const T *info) { return !info || info->Verify(*this); }
+
+	// Checks the length of a vector and that its elements fit. `end` is set
+	// to the position just past the last element.
+	bool VerifyVectorBytes(const uint8_t *vec, size_t elem_size, size_t *end) const {
+		if (!Verify<uofs_t>(vec)) return false;
+		auto len = static_cast<size_t>(ReadScalar<uofs_t, UnalignedReads>(vec));
+		auto elements = Position(vec) + sizeof(uofs_t);
+		if (len > (size_ - elements) / elem_size) return false;
+		*end = elements + len * elem_size;
+		return true;
+	}
+
+	template<typename T, typename ReadPolicy> 
+	bool VerifyVector(const Vector<T, ReadPolicy> *vec) const {
+		typedef IndirectHelper<T> helper;
+		auto p = reinterpret_cast<const uint8_t *>(vec);
+		size_t end;
+		return !vec ||
+			   (VerifyVectorBytes(p, helper::element_size, &end) &&
+				VerifyAlignment(p + sizeof(uofs_t), helper::element_alignment()));
+	}
+
+	template<typename ReadPolicy> 
+	bool VerifyString(const BasicString<ReadPolicy> *str) const {
+		size_t end;
+		return !str || (VerifyVectorBytes(reinterpret_cast<const uint8_t *>(str), 1, &end) &&
+						end < size_ && !buf_[end]);
+	}
+
+	// The vector itself is checked by VerifyVector() first.
+	template<typename ReadPolicy> 
+	bool VerifyVectorOfStrings(const Vector<Offset<String>, ReadPolicy> *vec) const {
+		if (!vec) return true;
+		for (uofs_t i = 0; i < vec->Length(); i++) {
+			auto str = VerifyOffset(reinterpret_cast<const uint8_t *>(
+				vec->GetStructFromOffset(i * sizeof(uofs_t))));
+			if (!str || !VerifyString(reinterpret_cast<const String *>(str))) return false;
+		}
+		return true;
+	}
+
+	template<typename T, typename ReadPolicy> 
+	bool VerifyVectorOfInfos(const Vector<Offset<T>, ReadPolicy> *vec) {
+		if (!vec) return true;
+		for (uofs_t i = 0; i < vec->Length(); i++) {
+			auto info = VerifyOffset(reinterpret_cast<const uint8_t *>(
+				vec->GetStructFromOffset(i * sizeof(uofs_t))));
+			if (!info || !reinterpret_cast<const T *>(info)->Verify(*this)) return false;
+		}
+		return true;
+	}
+
+	// What the elements of a vector refer to, for elements given by offset.
+	template<typename ReadPolicy> 
+	bool VerifyElements(const Vector<Offset<String>, ReadPolicy> *vec) {
+		return VerifyVectorOfStrings(vec);
+	}
+	template<typename T, typename ReadPolicy> 
+	bool VerifyElements(const Vector<Offset<T>, ReadPolicy> *vec) { return VerifyVectorOfInfos(vec); }
+	template<typename T, typename ReadPolicy> 
+	bool VerifyElements(const Vector<T, ReadPolicy> *) { return true; }
+
+	// The three vectors of a map, and that every slot refers to an entry, so
+	// lookups stay inside the keys and values.
+	template<typename K, typename V, typename ReadPolicy> 
+	bool VerifyMap(const Map<K, V, ReadPolicy> *map) {
+		if (!map) return true;
+		auto p = reinterpret_cast<const uint8_t *>(map);
+		typedef Vector<uofs_t, ReadPolicy> slots_type;
+		typedef Vector<K, ReadPolicy> keys_type;
+		typedef Vector<V, ReadPolicy> values_type;
+		auto slots = reinterpret_cast<const slots_type *>(VerifyOffset(p));
+		auto keys = reinterpret_cast<const keys_type *>(VerifyOffset(p + sizeof(uofs_t)));
+		auto values = reinterpret_cast<const values_type *>(VerifyOffset(p + 2 * sizeof(uofs_t)));
+		if (!slots || !keys || !values) return false;
+		if (!VerifyVector(slots) || !VerifyVector(keys) || !VerifyVector(values)) return false;
+		auto capacity = slots->Length();
+		auto len = keys->Length();
+		if (values->Length() != len || (capacity & (capacity - 1)) ||
+			(len && capacity <= len)) return false;
+		for (auto it = slots->begin(); it != slots->end(); ++it)
+			if (*it > len) return false;
+		return VerifyElements(keys) && VerifyElements(values);
+	}
+
+	// A buffer made by MegrezBuilder::Finish with a root of type T.
+	template<typename T> 
+	bool VerifyBuffer() {
+		auto root = VerifyOffset(buf_);
+		return root && reinterpret_cast<const T *>(root)->Verify(*this);
+	}
+
+	// A buffer made by MegrezBuilder::FinishSizePrefixed.
+	template<typename T> 
+	bool VerifySizePrefixedBuffer() {
+		if (!Verify<uofs_t>(buf_) ||
+			ReadScalar<uofs_t, UnalignedReads>(buf_) > size_ - sizeof(uofs_t)) return false;
+		auto root = VerifyOffset(buf_ + sizeof(uofs_t));
+		return root && reinterpret_cast<const T *>(root)->Verify(*this);
+	}
+
+	size_t GetDepth() const { return depth_; }
+	size_t GetNumInfos() const { return num_infos_; }
+};
+
+} // namespace megrez
+
+#endif // MEGREZ_VERIFIER_H_
@@ -1,3 +1,5 @@
-./MegrezC -c test.mgz
+./MegrezC -c --gen-object-api test.mgz
 g++ test.cc -o test -I ../
+g++ test.cc -o test_big_endian -I ../ -DMEGREZ_LITTLEENDIAN=0
+./test && ./test_big_endian
 read -p " "
\ No newline at end of file
@@ -23,7 +23,18 @@ using namespace megrez;
 using namespace std;
 using namespace chrono;
 
-const Person* Serialize() {
+// The checks below are also run with MEGREZ_LITTLEENDIAN=0, which byte
+// swaps everything on a little-endian machine, see autogen.sh.
+int failures = 0;
+
+#define TEST(condition) Test(condition, #condition, __LINE__)
+void Test(bool ok, const char *condition, int line) {
+	if (ok) return;
+	cout << "test.cc:" << line << ": failed: " << condition << "\n";
+	failures++;
+}
+
+DetachedBuffer Serialize() {
 	vector<uint64_t> vec;
 	for (size_t i=0; i<10; i++) 
 		vec.push_back(i);
@@ -32,24 +43,294 @@ const Person* Serialize() {
 	//auto name = mb.CreateString("Jiang");
 	string name = "Jiang";
 	auto lc = mb.CreateVector(vec);
-	auto elder_ = CreatePerson(mb, &addr, 92, name, lc, Color_Black);
+	auto elder_ = CreatePerson(mb, &addr, 92, name, lc, Color_Black, Pet_NONE,
+							   Offset<void>(), Offset<Vector<Offset<Person>>>(),
+							   Offset<Map<Offset<String>, int32_t>>());
 	mb.Finish(elder_);
-	const Person *elder = GetPerson(mb.GetBufferPointer());
-	return elder;
+	return mb.Release();
+}
+
+// Enum arrays are converted like the integers they are made of.
+void TestEnumVector() {
+	enum Level : uint16_t { kLow = 1, kMid = 2, kHigh = 0x300 };
+	const Level levels[] = { kLow, kMid, kHigh };
+	MegrezBuilder mb;
+	mb.Finish(mb.CreateVector(levels, 3));
+	auto vec = GetRoot<Vector<uint16_t>>(mb.GetBufferPointer());
+	TEST(vec->size() == 3);
+	TEST(vec->Get(0) == 1 && vec->Get(1) == 2 && vec->Get(2) == 0x300);
+	TEST(GetRoot<Vector<Level>>(mb.GetBufferPointer())->Get(2) == kHigh);
+}
+
+// A person with a dog, and `depth` levels of friends of `width` friends
+// each. The vector is built first so the buffer ends with it, not padding.
+DetachedBuffer SerializeWithPet(int depth, int width = 1) {
+	MegrezBuilder mb;
+	const uint64_t years[] = { 1, 2, 3 };
+	auto lc = mb.CreateVector(years, 3);
+	auto dog = CreateDog(mb, "Rex");
+	Offset<Person> person;
+	for (int level = 0; level < depth; level++) {
+		vector<Offset<Person>> friends(level ? width : 0, person);
+		PersonBuilder builder(mb);
+		builder.add_friends(mb.CreateVector(friends));
+		person = builder.Finish();
+	}
+	PersonBuilder builder(mb);
+	builder.add_LifeContinue(lc);
+	builder.add_pet_type(Pet_Dog);
+	builder.add_pet(dog.Union());
+	if (depth) builder.add_friends(mb.CreateVector(&person, 1));
+	mb.Finish(builder.Finish());
+	return mb.Release();
+}
+
+bool VerifyPerson(const uint8_t *buf, size_t size, size_t max_depth = 64,
+				  size_t max_infos = 1000000) {
+	Verifier verifier(buf, size, max_depth, max_infos);
+	return VerifyPersonBuffer(verifier);
+}
+
+// Buffers cut short or with bad offsets are rejected, down to the info a
+// union refers to, and so are ones nested too deep or with too many infos.
+void TestVerifier() {
+	auto buf = SerializeWithPet(0);
+	TEST(VerifyPerson(buf.data(), buf.size()));
+	int accepted = 0;
+	for (size_t size = 0; size < buf.size(); size++)
+		accepted += VerifyPerson(buf.data(), size);
+	TEST(accepted == 0);
+
+	vector<uint8_t> bad(buf.data(), buf.data() + buf.size());
+	auto person = GetPerson(bad.data());
+	auto dog = reinterpret_cast<const Dog *>(person->pet());
+	auto name = const_cast<String *>(dog->name());
+	WriteScalar(reinterpret_cast<uint8_t *>(name), static_cast<uofs_t>(bad.size()));
+	TEST(!VerifyPerson(bad.data(), bad.size()));
+
+	bad.assign(buf.data(), buf.data() + buf.size());
+	auto root = reinterpret_cast<uofs_t *>(bad.data());
+	WriteScalar(root, static_cast<uofs_t>(bad.size()));
+	TEST(!VerifyPerson(bad.data(), bad.size()));
+
+	MegrezBuilder mb;
+	auto dog_ = CreateDog(mb, "Rex");
+	PersonBuilder builder(mb);
+	builder.add_pet_type(Pet_Cat + 1);
+	builder.add_pet(dog_.Union());
+	mb.Finish(builder.Finish());
+	TEST(!VerifyPerson(mb.GetBufferPointer(), mb.GetSize()));
+
+	// The root, three levels of friends, and the dog at the root.
+	auto deep = SerializeWithPet(3);
+	TEST(VerifyPerson(deep.data(), deep.size(), 4));
+	TEST(!VerifyPerson(deep.data(), deep.size(), 3));
+
+	// Friends are shared, but counted each time they are reached: the root,
+	// its friend, 10 friends of 10 friends each, and the dog.
+	auto wide = SerializeWithPet(3, 10);
+	TEST(VerifyPerson(wide.data(), wide.size(), 64, 113));
+	TEST(!VerifyPerson(wide.data(), wide.size(), 64, 112));
+}
+
+// Pack(UnPack()) keeps every field, the union and the map included, and
+// the unpacked objects can be changed before packing them again.
+void TestObjectApi() {
+	MegrezBuilder mb;
+	const uint64_t years[] = { 1, 2, 3 };
+	auto lc = mb.CreateVector(years, 3);
+	auto dog = CreateDog(mb, "Rex");
+	auto friend_ = CreatePerson(mb, nullptr, 5, "Ann", Offset<Vector<uint64_t>>(), Color_Red,
+								Pet_NONE, Offset<void>(), Offset<Vector<Offset<Person>>>(),
+								Offset<Map<Offset<String>, int32_t>>());
+	vector<Offset<String>> keys = { mb.CreateString("home"), mb.CreateString("work") };
+	vector<int32_t> numbers = { 1, 2 };
+	auto phones = mb.CreateMap(keys, numbers);
+	auto addr = address(1, 2, 3);
+	mb.Finish(CreatePerson(mb, &addr, 30, "Jiang", lc, Color_Blue, Pet_Dog, dog.Union(),
+						   mb.CreateVector(&friend_, 1), phones));
+
+	ArenaAllocator arena;
+	auto person = UnPackPerson(mb.GetBufferPointer(), &arena);
+	TEST(person->Address && person->Address->street() == 2);
+	TEST(person->age == 30 && person->name == "Jiang" && person->GlassColor == Color_Blue);
+	TEST(person->LifeContinue.size() == 3 && person->LifeContinue[2] == 3);
+	TEST(person->pet.type == Pet_Dog && person->pet.As<DogT>()->name == "Rex");
+	TEST(person->friends.size() == 1 && person->friends[0]->name == "Ann" &&
+		 person->friends[0]->age == 5 && person->friends[0]->pet.type == Pet_NONE);
+	TEST(person->phones.size() == 2);
+
+	auto cat = MakeObj<CatT>(&arena, &arena);
+	cat->lives = 3;
+	person->pet.Set(Pet_Cat, std::move(cat));
+	person->phones.emplace_back(ObjString("cell", StlAllocator<char>(&arena)), 3);
+	MegrezBuilder packed;
+	FinishPersonBuffer(packed, *person);
+	Verifier verifier(packed.GetBufferPointer(), packed.GetSize());
+	TEST(VerifyPersonBuffer(verifier));
+
+	auto result = GetPerson(packed.GetBufferPointer());
+	TEST(result->Address()->number() == 3 && result->age() == 30);
+	TEST(result->name()->str() == "Jiang" && result->GlassColor() == Color_Blue);
+	TEST(result->LifeContinue()->size() == 3 && result->LifeContinue()->Get(1) == 2);
+	TEST(result->pet_type() == Pet_Cat &&
+		 reinterpret_cast<const Cat *>(result->pet())->lives() == 3);
+	TEST(result->friends()->size() == 1 && result->friends()->Get(0)->age() == 5);
+	int32_t number = 0;
+	TEST(result->phones()->size() == 3);
+	TEST(result->phones()->Find("home", &number) && number == 1);
+	TEST(result->phones()->Find("work", &number) && number == 2);
+	TEST(result->phones()->Find("cell", &number) && number == 3);
 }
 
+// Every key is found at its index, among enough entries for probes to
+// collide, and keys that aren't there aren't.
+void TestMap() {
+	const int count = 100;
+	MegrezBuilder mb;
+	vector<int32_t> numbers, squares;
+	for (int i = 0; i < count; i++) {
+		numbers.push_back(i * 7 - 300);
+		squares.push_back(i * i);
+	}
+	mb.Finish(mb.CreateMap(numbers, squares));
+	auto by_number = GetRoot<Map<int32_t, int32_t>>(mb.GetBufferPointer());
+	TEST(by_number->size() == count);
+	int found = 0;
+	for (int i = 0; i < count; i++) {
+		int32_t square = -1;
+		found += by_number->IndexOf(i * 7 - 300) == uofs_t(i) &&
+				 by_number->Find(i * 7 - 300, &square) && square == i * i;
+	}
+	TEST(found == count);
+	TEST(by_number->IndexOf(2) == by_number->npos && !by_number->Contains(-301));
+
+	MegrezBuilder smb;
+	vector<Offset<String>> names;
+	vector<int64_t> ids;
+	for (int i = 0; i < count; i++) {
+		names.push_back(smb.CreateString("key" + to_string(i)));
+		ids.push_back(i * 1000000000000LL);
+	}
+	smb.Finish(smb.CreateMap(names, ids));
+	auto by_name = GetRoot<Map<Offset<String>, int64_t>>(smb.GetBufferPointer());
+	found = 0;
+	for (int i = 0; i < count; i++) {
+		auto name = "key" + to_string(i);
+		int64_t id = -1;
+		found += by_name->IndexOf(name) == uofs_t(i) &&
+				 by_name->keys()->Get(i)->str() == name &&
+				 by_name->Find(name, &id) && id == i * 1000000000000LL;
+	}
+	TEST(found == count);
+	TEST(!by_name->Contains("key100") && !by_name->Contains("key1x") && !by_name->Contains(""));
+
+	MegrezBuilder emb;
+	emb.Finish(emb.CreateMap(vector<int32_t>(), vector<int32_t>()));
+	auto empty = GetRoot<Map<int32_t, int32_t>>(emb.GetBufferPointer());
+	TEST(empty->size() == 0 && empty->IndexOf(0) == empty->npos);
+}
+
+// Children created while their parent is open: strings, vectors, maps and
+// infos, two levels deep, with fields of the parent added between them.
+void TestNestedBuilding() {
+	MegrezBuilder mb;
+	PersonBuilder parent(mb);
+	parent.add_age(40);
+	parent.add_name(mb.CreateString("Jiang"));
+	const uint64_t years[] = { 7, 8, 9 };
+	parent.add_LifeContinue(mb.CreateVector(years, 3));
+	parent.add_GlassColor(Color_Green);
+	DogBuilder dog(mb);
+	dog.add_name(mb.CreateString("Rex"));
+	parent.add_pet(dog.Finish().Union());
+	parent.add_pet_type(Pet_Dog);
+	auto addr = address(4, 5, 6);
+	parent.add_Address(&addr);
+	PersonBuilder child(mb);
+	child.add_age(8);
+	child.add_name(mb.CreateString("Ann"));
+	auto child_ = child.Finish();
+	parent.add_friends(mb.CreateVector(&child_, 1));
+	vector<Offset<String>> keys = { mb.CreateString("home") };
+	parent.add_phones(mb.CreateMap(keys, vector<int32_t>(1, 42)));
+	mb.Finish(parent.Finish());
+
+	Verifier verifier(mb.GetBufferPointer(), mb.GetSize());
+	TEST(VerifyPersonBuffer(verifier));
+	auto person = GetPerson(mb.GetBufferPointer());
+	TEST(person->age() == 40 && person->name()->str() == "Jiang");
+	TEST(person->LifeContinue()->size() == 3 && person->LifeContinue()->Get(2) == 9);
+	TEST(person->GlassColor() == Color_Green && person->pet_type() == Pet_Dog);
+	TEST(reinterpret_cast<const Dog *>(person->pet())->name()->str() == "Rex");
+	TEST(person->Address()->block() == 4 && person->Address()->number() == 6);
+	TEST(person->friends()->size() == 1 && person->friends()->Get(0)->age() == 8 &&
+		 person->friends()->Get(0)->name()->str() == "Ann");
+	int32_t number = 0;
+	TEST(person->phones()->Find("home", &number) && number == 42);
+
+	// A struct written in place with StartStruct(), right after a child.
+	MegrezBuilder smb;
+	PersonBuilder in_place(smb);
+	auto name = smb.CreateString("Ming");
+	smb.StartStruct(AlignOf<address>());
+	smb.PushBytes(reinterpret_cast<const uint8_t *>(&addr), sizeof(addr));
+	smb.AddStructOffset(4, smb.GetSize());
+	in_place.add_name(name);
+	smb.Finish(in_place.Finish());
+	person = GetPerson(smb.GetBufferPointer());
+	TEST(person->name()->str() == "Ming" && person->Address()->street() == 5);
+}
+
+// A buffer one byte off its alignment, read through the runtime types
+// with UnalignedReads, as the --unaligned-reads accessors do. The generated
+// code here reads aligned, Verify() included, so it isn't used.
+void TestUnalignedReads() {
+	MegrezBuilder pmb;
+	const uint64_t years[] = { 1ULL << 40, 2, 3 };
+	auto lc = pmb.CreateVector(years, 3);
+	auto addr_ = address(1, 2, 3);
+	pmb.Finish(CreatePerson(pmb, &addr_, 30, "Jiang", lc, Color_Red, Pet_NONE, Offset<void>(),
+							Offset<Vector<Offset<Person>>>(), Offset<Map<Offset<String>, int32_t>>()));
+	vector<uint8_t> storage(pmb.GetSize() + 1);
+	auto odd = storage.data() + 1;
+	memcpy(odd, pmb.GetBufferPointer(), pmb.GetSize());
+
+	typedef UnalignedReads U;
+	auto person = GetRoot<Info, U>(odd);
+	TEST((person->GetField<int16_t, U>(FieldIndexToOffset(1), 92)) == 30);
+	TEST((person->GetField<int8_t, U>(FieldIndexToOffset(4), Color_Black)) == Color_Red);
+	auto name = person->GetPointer<const BasicString<U> *, U>(FieldIndexToOffset(2));
+	TEST(name->str() == "Jiang");
+	auto lifes = person->GetPointer<const Vector<uint64_t, U> *, U>(FieldIndexToOffset(3));
+	TEST(lifes->size() == 3 && lifes->Get(0) == 1ULL << 40 && lifes->Get(2) == 3);
+	address addr(0, 0, 0);
+	memcpy(&addr, (person->GetStruct<const uint8_t *, U>(FieldIndexToOffset(0))), sizeof(addr));
+	TEST(addr.street() == 2);
+
+	MegrezBuilder mb;
+	vector<int64_t> keys = { 5, -5 }, values = { 50, -50 };
+	mb.Finish(mb.CreateMap(keys, values));
+	storage.assign(mb.GetSize() + 1, 0);
+	odd = storage.data() + 1;
+	memcpy(odd, mb.GetBufferPointer(), mb.GetSize());
+	int64_t value = 0;
+	TEST((GetRoot<Map<int64_t, int64_t, U>, U>(odd)->Find(-5, &value)) && value == -50);
+}
 
 int main() {
-	const Person* elder;
+	DetachedBuffer buf;
 	auto start = system_clock::now();
 	for (int i=1; i<=10000; i++)
-		elder = Serialize();
+		buf = Serialize();
 	auto end = system_clock::now();
 	auto duration = duration_cast<nanoseconds>(end - start);
 	cout << "Serialization time: " 
 		 << double(duration.count()) * nanoseconds::period::num / nanoseconds::period::den 
 		 << "(nanoseconds).\n\n";
 
+	const Person *elder = GetPerson(buf.data());
+
 	cout << elder->name()->c_str() << endl << endl;
 	cout << elder->age() << endl << endl;
 	cout << elder->Address()->block() << endl;
@@ -59,8 +340,18 @@ int main() {
 	cout << elder->LifeContinue()->Get(2) << endl;
 	cout << elder->LifeContinue()->Get(3) << endl << endl;
 	if (elder->GlassColor() == Color_Black)
-		cout << "Black Glass [=]-[=]!";
-	cin.get();
-	cin.get();
+		cout << "Black Glass [=]-[=]!\n\n";
+
+	TestEnumVector();
+	TestVerifier();
+	TestObjectApi();
+	TestMap();
+	TestNestedBuilding();
+	TestUnalignedReads();
+	if (failures) {
+		cout << failures << " checks failed.\n";
+		return 1;
+	}
+	cout << "All checks passed.\n";
 	return 0;
 }
\ No newline at end of file